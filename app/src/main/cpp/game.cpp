@@ -11,7 +11,15 @@
 
 #include "gp_platform.h"
 #include "gp_model.h"
+#include "gp_mesh.h"
+#include "gp_jobs.h"
+#include "gp_loader.h"
+#include "gp_pack.h"
+#include "gp_etc.h"
+#include "gp_ktx.h"
+#include "gp_pixels.h"
 #include "gp_gl.h"
+#include "gp_shader.h"
 
 #define STB_TRUETYPE_IMPLEMENTATION
 #define STB_RECT_PACK_IMPLEMENTATION
@@ -30,7 +38,57 @@
 
 #include "gp_line_renderer.h"
 
+#include "gp_atlas.h"
+#include "gp_texture_budget.h"
+#include "gp_texture_stream.h"
+#include "gp_render_queue.h"
+
 #define RENDER_MODELS true
+// Times the asset paths once at startup, before anything else is loaded
+#define RUN_STARTUP_BENCHMARKS false
+// Loads (image decodes, font bake, model processing) run at the same time on the jobs pool, false runs them
+// one after another on the loader thread. Compare the "assets ready" log of both.
+#define LOADER_PARALLEL_LOADS true
+// Draws the models from client side arrays instead of GL buffers, the driver then copies every vertex of a model on
+// every draw. For debugging, the vertices stay in memory.
+#define MODEL_CLIENT_ARRAYS false
+// request_model flag, the model is drawn with render_model_instanced
+#define LOAD_MODEL_INSTANCED (1 << 0)
+// Instances of one render_model_instanced call
+#define MODEL_MAX_INSTANCES 256
+// Instances per draw without instanced arrays, the size of instance_matrices in vs_batched_source. 16 matrices
+// and the other uniforms stay under the 128 vertex uniform vectors every ES 2 driver has.
+#define MODEL_BATCH_INSTANCES 16
+// GL memory for the vertex copies of a model drawn in batches, fewer instances per draw above it
+#define MODEL_BATCH_MAX_KB 4096
+
+// Time the render thread spends each frame handing finished loads to GL
+#define LOADER_FRAME_BUDGET_MS 4.0f
+#define LOAD_TEXTURE_FLIP (1 << 0)
+// Builds the full mip chain on the loader and samples the texture trilinear
+#define LOAD_TEXTURE_MIPMAPS (1 << 1)
+// Colour image, mip levels are averaged in linear space
+#define LOAD_TEXTURE_SRGB (1 << 2)
+// Encoded to ETC1 on the loader when the GL supports it, uncompressed otherwise. ETC1 has no alpha, only for
+// textures whose alpha does not matter where the model samples them (cut out atlas gutters)
+#define LOAD_TEXTURE_COMPRESS (1 << 3)
+// Packed to 16 bit texels on the loader when the texture is not ETC1, half the GL memory and upload bytes of RGBA8
+// with some banding on smooth gradients. RGB565 drops alpha, RGBA5551 keeps one bit of it.
+#define LOAD_TEXTURE_RGB565 (1 << 4)
+#define LOAD_TEXTURE_RGBA4444 (1 << 5)
+#define LOAD_TEXTURE_RGBA5551 (1 << 6)
+// Only the first channel, as GL_LUMINANCE. For grey images (ambient occlusion, masks)
+#define LOAD_TEXTURE_LUMINANCE (1 << 7)
+// Colour multiplied by alpha before the mip levels are built, for blending with GL_ONE, GL_ONE_MINUS_SRC_ALPHA
+#define LOAD_TEXTURE_PREMULTIPLY (1 << 8)
+// GL memory for the textures, the least recently used ones are evicted or lose their top levels past it
+#define TEXTURE_BUDGET_MB 64
+// Texture bytes uploaded each frame past the first, small levels of a texture go up first (see gp_texture_stream.h)
+#define TEXTURE_STREAM_FRAME_KB 2048
+// Largest atlas side, an RGBA atlas this size takes 21 MB with its mip levels
+#define ATLAS_MAX_SIZE 2048
+// Frames between the texture bind stats logs
+#define RENDER_STATS_FRAMES 600
 
 
 // TODO LIST
@@ -81,17 +139,23 @@ auto fs_font_source =
         //"  gl_FragColor = vec4(0.0,1.0,0.0,1.0);\n"
         "}\n";
 
+// Quantized models are decoded with the per submodel offset / scale, see smodel_decode_transform
 auto vs_textured_source =
         "attribute vec4 vertex_position;\n"
         "attribute vec2 vertex_uvs;\n"
         "uniform mat4 model_matrix;\n"
         "uniform mat4 view_matrix;\n"
         "uniform mat4 projection_matrix;\n"
+        "uniform vec3 position_offset;\n"
+        "uniform vec3 position_scale;\n"
+        "uniform vec2 uv_offset;\n"
+        "uniform vec2 uv_scale;\n"
         "uniform float roll;\n"
         "varying vec2 v_uvs;\n"
         "void main() {\n"
-        "  v_uvs = vertex_uvs;"
-        "  gl_Position = projection_matrix * view_matrix * model_matrix * vertex_position;\n"
+        "  v_uvs = uv_offset + vertex_uvs * uv_scale;"
+        "  vec4 position = vec4(position_offset + vertex_position.xyz * position_scale, 1.0);\n"
+        "  gl_Position = projection_matrix * view_matrix * model_matrix * position;\n"
         "}\n";
 
 auto fs_textured_source =
@@ -103,6 +167,44 @@ auto fs_textured_source =
         "  gl_FragColor = texture2D(texture_unit, v_uvs);\n"
         "}\n";
 
+// vs_textured_source with the model matrix of each instance in a per instance attribute, for instanced arrays
+auto vs_instanced_source =
+        "attribute vec4 vertex_position;\n"
+        "attribute vec2 vertex_uvs;\n"
+        "attribute mat4 instance_matrix;\n"
+        "uniform mat4 view_matrix;\n"
+        "uniform mat4 projection_matrix;\n"
+        "uniform vec3 position_offset;\n"
+        "uniform vec3 position_scale;\n"
+        "uniform vec2 uv_offset;\n"
+        "uniform vec2 uv_scale;\n"
+        "varying vec2 v_uvs;\n"
+        "void main() {\n"
+        "  v_uvs = uv_offset + vertex_uvs * uv_scale;"
+        "  vec4 position = vec4(position_offset + vertex_position.xyz * position_scale, 1.0);\n"
+        "  gl_Position = projection_matrix * view_matrix * instance_matrix * position;\n"
+        "}\n";
+
+// vs_textured_source with the model matrices of a batch of instances in a uniform array, indexed by the instance
+// index of the vertex copies (see upload_model_batch_buffers). The array size is MODEL_BATCH_INSTANCES.
+auto vs_batched_source =
+        "attribute vec4 vertex_position;\n"
+        "attribute vec2 vertex_uvs;\n"
+        "attribute float instance_index;\n"
+        "uniform mat4 instance_matrices[16];\n"
+        "uniform mat4 view_matrix;\n"
+        "uniform mat4 projection_matrix;\n"
+        "uniform vec3 position_offset;\n"
+        "uniform vec3 position_scale;\n"
+        "uniform vec2 uv_offset;\n"
+        "uniform vec2 uv_scale;\n"
+        "varying vec2 v_uvs;\n"
+        "void main() {\n"
+        "  v_uvs = uv_offset + vertex_uvs * uv_scale;"
+        "  vec4 position = vec4(position_offset + vertex_position.xyz * position_scale, 1.0);\n"
+        "  gl_Position = projection_matrix * view_matrix * instance_matrices[int(instance_index)] * position;\n"
+        "}\n";
+
 // Values
 float3 ORIGIN = {0, 0, 0};
 float3 X_AXIS = {1, 0, 0};
@@ -121,8 +223,21 @@ bool touch_is_down = false;
 float3 touch_model_trans = {0.0, 0.0, 0.0};
 float3 touch_ray_world;
 
+// Shaders
+ShaderProgram model_shader;
+ShaderProgram font_shader;
+// vs_instanced_source with instanced arrays, vs_batched_source otherwise
+ShaderProgram instanced_shader;
+
+// Draws, submitted in any order and sorted each frame
+RenderQueue render_queue;
+RenderMaterial trooper_material;
+RenderMaterial trooper_instanced_material;
+RenderMaterial test_material;
+RenderMaterial duck_material;
+#define RENDER_LAYER_WORLD 0
+
 // Fonts
-GLuint font_shader_program;
 FontData font_data;
 
 // Lines
@@ -150,10 +265,47 @@ SModelData sphere_model;
 SModelData duck_model;
 SModelData cube_model;
 
+bool has_32bit_indices = false;
+// Mip levels for non power of two textures, see gl_has_npot_textures
+bool has_npot_mips = false;
+// GL_OES_compressed_ETC1_RGB8_texture
+bool has_etc1 = false;
+// GL_OES_vertex_array_object or ES 3
+bool has_vertex_arrays = false;
+// ES 3, GL_EXT_instanced_arrays or GL_ANGLE_instanced_arrays
+bool has_instanced_arrays = false;
+// Model matrices of the visible instances of a render_model_instanced call, streamed to instance_buffer with
+// instanced arrays
+float instance_matrices[MODEL_MAX_INSTANCES * 16];
+GLuint instance_buffer = 0;
+
+// Detail level each draw used last frame, see mesh_select_lod
+#define TROOPER_GRID 2
+#define TROOPER_INSTANCES (TROOPER_GRID * TROOPER_GRID)
+static_assert(TROOPER_INSTANCES <= MODEL_MAX_INSTANCES, "one instanced draw for the troopers");
+int plane_lods[2] = {0};
+int sphere_lod = 0;
+int cube_lod = 0;
+int duck_lod = 0;
+int trooper_lods[TROOPER_INSTANCES] = {0};
+
 // Textures
-GLuint trooper_texture = 0;
-GLuint test_texture = 0;
-GLuint duck_texture = 0;
+TextureAtlas model_atlas;
+TextureRegion trooper_texture;
+TextureRegion test_texture;
+TextureRegion duck_texture;
+TextureBudget texture_budget;
+TextureStreams texture_streams;
+
+// Models and instances drawn in the current frame and the GL draw calls it took, gp_gl_state.h counts the
+// texture binds
+int model_draws = 0;
+int model_draw_calls = 0;
+int frame_count = 0;
+
+// Loading
+double init_time_ms = 0;
+bool assets_ready = false;
 
 /**
  * M_MATH.H extras
@@ -209,13 +361,105 @@ update_camera(Camera *camera, float view_matrix[], float px, float py, float pz,
 
 }
 
+SModelData load_model(const char *file_name) {
+    SModelData model = load_smodel(file_name);
+    if (model.submodel_count == 0) {
+        // missing or broken, render_model skips it
+        return model;
+    }
+    if (model.vertices) {
+        // converted offline, already welded, optimized and quantized
+        mesh_cache_lod_selection(&model);
+        return model;
+    }
+
+    MeshWeldStats stats;
+    if (!model.index_count && mesh_weld(&model, has_32bit_indices, &stats)) {
+        log_fmt("%s welded: %d -> %d vertices, vertex memory %d -> %d bytes (+%d index bytes), vertex shader invocations %d -> %d",
+                file_name, stats.shaded_vertices_before, model.vertex_number, stats.vertex_bytes_before,
+                stats.vertex_bytes_after, stats.index_bytes, stats.shaded_vertices_before,
+                stats.shaded_vertices_after);
+
+        MeshCacheStats before = mesh_cache_stats(&model, MESH_VERTEX_CACHE_SIZE);
+        mesh_optimize(&model);
+        MeshCacheStats after = mesh_cache_stats(&model, MESH_VERTEX_CACHE_SIZE);
+        log_fmt("%s optimized: ACMR %.3f -> %.3f ATVR %.3f -> %.3f", file_name, before.acmr, after.acmr,
+                before.atvr, after.atvr);
+
+        mesh_build_lods(&model, SMODEL_MAX_LODS);
+        MeshLodStats lod_stats = mesh_lod_stats(&model);
+        for (int lod = 0; lod < lod_stats.lod_count; ++lod) {
+            log_fmt("%s lod %d: %d triangles error %f", file_name, lod, lod_stats.triangle_count[lod],
+                    lod_stats.error[lod]);
+        }
+    }
+
+    MeshQuantizeStats quantize_stats;
+    mesh_quantize(&model, &quantize_stats);
+    log_fmt("%s quantized: vertex memory %d -> %d bytes, max position error %f", file_name,
+            quantize_stats.vertex_bytes_before, quantize_stats.vertex_bytes_after,
+            quantize_stats.max_position_error);
+    mesh_cache_lod_selection(&model);
+    return model;
+}
+
+// Decodes straight from the mapped (or pack) view of the file, no stdio in between.
+// @note Runs on several loader jobs at once, stbi_set_flip_vertically_on_load is a global so the rows are
+// flipped here instead.
+// desired_channels 0 keeps the channels of the file, otherwise *channels is desired_channels.
+unsigned char *decode_image(const char *texture_path, bool flip_on_load, int *width, int *height, int *channels,
+                            int desired_channels = 0) {
+    FileView file;
+    if (!map_file(texture_path, &file)) {
+        log_fmt("decode_image: could not open %s", texture_path);
+        return NULL;
+    }
+    unsigned char *pixels = stbi_load_from_memory((const stbi_uc *) file.data, (int) file.size, width, height,
+                                                  channels, desired_channels);
+    unmap_file(&file);
+    if (desired_channels) {
+        *channels = desired_channels;
+    }
+    if (pixels && flip_on_load) {
+        pixels_flip_rows(pixels, *width, *height, *channels);
+    }
+    return pixels;
+}
+
+// Compares decoding through the stdio asset shim with decoding from the mapped view
+void benchmark_image_decode(const char *texture_path, int iterations) {
+    double stdio_ms = 0;
+    double memory_ms = 0;
+    for (int i = 0; i < iterations; ++i) {
+        int width;
+        int height;
+        int channels;
+
+        double start = loader_time_ms();
+        FILE *file = open_asset_stdio(texture_path);
+        assert(file);
+        unsigned char *pixels = stbi_load_from_file(file, &width, &height, &channels, 0);
+        fclose(file);
+        assert(pixels != NULL);
+        stbi_image_free(pixels);
+        stdio_ms += loader_time_ms() - start;
+
+        start = loader_time_ms();
+        pixels = decode_image(texture_path, true, &width, &height, &channels);
+        assert(pixels != NULL);
+        stbi_image_free(pixels);
+        memory_ms += loader_time_ms() - start;
+    }
+    log_fmt("benchmark_image_decode %s: stdio shim %.2f ms, mapped memory %.2f ms per decode", texture_path,
+            stdio_ms / iterations, memory_ms / iterations);
+}
+
 GLuint prepare_texture(const char *texture_path, bool flip_on_load) {
     log_fmt("Loading texture %s\n", texture_path);
     int width;
     int height;
     int channels;
-    stbi_set_flip_vertically_on_load(flip_on_load);
-    unsigned char *pixels = stbi_load(texture_path, &width, &height, &channels, 0);
+    unsigned char *pixels = decode_image(texture_path, flip_on_load, &width, &height, &channels);
     assert(pixels != NULL);
     log_fmt("Texture |%s| w: %d h: %d channels: %d is_null?: %d \n", texture_path, width, height,
             channels,
@@ -227,6 +471,615 @@ GLuint prepare_texture(const char *texture_path, bool flip_on_load) {
     return texture;
 }
 
+typedef struct {
+    // decoded image, null once levels replace it
+    unsigned char *pixels;
+    int width;
+    int height;
+    int channels;
+    ImageMips mips;
+    // levels for upload_texture_data, ETC1 encoded on the loader, a KTX file or pixels and mips
+    GLenum format;
+    GLenum type;
+    int level_count;
+    TextureLevel levels[IMAGE_MAX_LEVELS];
+    // what levels point into, a heap block or the mapped KTX file
+    unsigned char *level_block;
+    FileView file;
+    bool mapped;
+} TextureLoad;
+
+void free_texture_load(TextureLoad *load) {
+    free(load->level_block);
+    if (load->mapped) {
+        unmap_file(&load->file);
+    }
+    image_free_mips(&load->mips);
+    stbi_image_free(load->pixels);
+}
+
+void release_texture_load(void *payload) {
+    free_texture_load((TextureLoad *) payload);
+    free(payload);
+}
+
+// Points levels at pixels and its mip levels
+void texture_load_mip_levels(TextureLoad *load) {
+    ImageLevel single = {load->width, load->height, load->pixels};
+    const ImageLevel *levels = load->mips.level_count ? load->mips.levels : &single;
+    load->level_count = load->mips.level_count ? load->mips.level_count : 1;
+    load->format = gl_pixel_format(load->channels);
+    load->type = GL_UNSIGNED_BYTE;
+    for (int i = 0; i < load->level_count; ++i) {
+        TextureLevel *level = &load->levels[i];
+        level->width = levels[i].width;
+        level->height = levels[i].height;
+        level->data = levels[i].pixels;
+        level->size = (size_t) level->width * level->height * load->channels;
+    }
+}
+
+// Encodes every level of load to ETC1 and releases the uncompressed ones
+void compress_texture_etc1(TextureLoad *load) {
+    ImageLevel single = {load->width, load->height, load->pixels};
+    const ImageLevel *levels = load->mips.level_count ? load->mips.levels : &single;
+    int level_count = load->mips.level_count ? load->mips.level_count : 1;
+
+    size_t total_size = 0;
+    for (int i = 0; i < level_count; ++i) {
+        total_size += etc1_image_size(levels[i].width, levels[i].height);
+    }
+    load->level_block = (unsigned char *) malloc(total_size);
+    load->format = GL_ETC1_RGB8_OES;
+    load->type = 0;
+    load->level_count = level_count;
+    size_t offset = 0;
+    for (int i = 0; i < level_count; ++i) {
+        TextureLevel *level = &load->levels[i];
+        level->width = levels[i].width;
+        level->height = levels[i].height;
+        level->data = load->level_block + offset;
+        level->size = etc1_image_size(level->width, level->height);
+        etc1_encode_image(levels[i].pixels, level->width, level->height, load->channels,
+                          load->level_block + offset);
+        offset += level->size;
+    }
+
+    image_free_mips(&load->mips);
+    stbi_image_free(load->pixels);
+    load->pixels = NULL;
+}
+
+// Packs every level of load into the upload format flags ask for (LOAD_TEXTURE_RGB565 / RGBA4444 / RGBA5551 /
+// LUMINANCE) and releases the 8 bit ones. 16 bit packing takes 3 or 4 channel images.
+void pack_texture_levels(TextureLoad *load, int flags) {
+    ImageLevel single = {load->width, load->height, load->pixels};
+    const ImageLevel *levels = load->mips.level_count ? load->mips.levels : &single;
+    int level_count = load->mips.level_count ? load->mips.level_count : 1;
+    bool luminance = (flags & LOAD_TEXTURE_LUMINANCE) != 0;
+    if (luminance) {
+        load->format = GL_LUMINANCE;
+        load->type = GL_UNSIGNED_BYTE;
+    } else if (flags & LOAD_TEXTURE_RGB565) {
+        load->format = GL_RGB;
+        load->type = GL_UNSIGNED_SHORT_5_6_5;
+    } else if (flags & LOAD_TEXTURE_RGBA4444) {
+        load->format = GL_RGBA;
+        load->type = GL_UNSIGNED_SHORT_4_4_4_4;
+    } else {
+        load->format = GL_RGBA;
+        load->type = GL_UNSIGNED_SHORT_5_5_5_1;
+    }
+    int texel_size = gl_texel_size(load->format, load->type);
+
+    size_t total_size = 0;
+    for (int i = 0; i < level_count; ++i) {
+        total_size += (size_t) levels[i].width * levels[i].height * texel_size;
+    }
+    load->level_block = (unsigned char *) malloc(total_size);
+    // the packing kernels read RGBA, 3 channel levels are expanded into it first
+    unsigned char *rgba = NULL;
+    if (!luminance && load->channels == 3) {
+        rgba = (unsigned char *) malloc((size_t) load->width * load->height * 4);
+    }
+    load->level_count = level_count;
+    size_t offset = 0;
+    for (int i = 0; i < level_count; ++i) {
+        TextureLevel *level = &load->levels[i];
+        level->width = levels[i].width;
+        level->height = levels[i].height;
+        level->data = load->level_block + offset;
+        level->size = (size_t) level->width * level->height * texel_size;
+        size_t count = (size_t) level->width * level->height;
+        unsigned char *result = load->level_block + offset;
+        if (luminance) {
+            pixels_extract_channel(levels[i].pixels, load->channels, 0, result, count);
+        } else {
+            const unsigned char *texels = levels[i].pixels;
+            if (rgba) {
+                pixels_rgb_to_rgba(texels, rgba, count);
+                texels = rgba;
+            }
+            if (load->type == GL_UNSIGNED_SHORT_5_6_5) {
+                pixels_pack_rgb565(texels, (uint16_t *) result, count);
+            } else if (load->type == GL_UNSIGNED_SHORT_4_4_4_4) {
+                pixels_pack_rgba4444(texels, (uint16_t *) result, count);
+            } else {
+                pixels_pack_rgba5551(texels, (uint16_t *) result, count);
+            }
+        }
+        offset += level->size;
+    }
+
+    free(rgba);
+    image_free_mips(&load->mips);
+    stbi_image_free(load->pixels);
+    load->pixels = NULL;
+}
+
+// Without GL_OES_compressed_ETC1_RGB8_texture ETC1 files are decoded to RGBA on the loader
+void decode_texture_etc1(TextureLoad *load, const KtxTexture *ktx) {
+    size_t total_size = 0;
+    for (int i = 0; i < ktx->level_count; ++i) {
+        total_size += (size_t) ktx->levels[i].width * ktx->levels[i].height * 4;
+    }
+    load->level_block = (unsigned char *) malloc(total_size);
+    load->format = GL_RGBA;
+    load->type = GL_UNSIGNED_BYTE;
+    size_t offset = 0;
+    for (int i = 0; i < ktx->level_count; ++i) {
+        TextureLevel *level = &load->levels[i];
+        level->width = ktx->levels[i].width;
+        level->height = ktx->levels[i].height;
+        level->data = load->level_block + offset;
+        level->size = (size_t) level->width * level->height * 4;
+        etc1_decode_image(ktx->levels[i].data, level->width, level->height, 4, load->level_block + offset);
+        offset += level->size;
+    }
+}
+
+// duck.png -> duck.ktx
+void texture_ktx_path(const char *texture_path, char *ktx_path, size_t size) {
+    const char *extension = strrchr(texture_path, '.');
+    int stem_length = extension ? (int) (extension - texture_path) : (int) strlen(texture_path);
+    snprintf(ktx_path, size, "%.*s%s", stem_length, texture_path, KTX_EXTENSION);
+}
+
+// Shipped textures, the levels point straight into the mapping until the upload. Without keep_compressed
+// ETC1 files are decoded to RGBA.
+bool load_ktx_texture(TextureLoad *load, const char *ktx_path, bool keep_compressed) {
+    if (!map_file(ktx_path, &load->file)) {
+        return false;
+    }
+    KtxTexture ktx;
+    bool supported = ktx_parse(load->file.data, load->file.size, &ktx);
+    if (supported && ktx.gl_type == 0 && ktx.gl_format != ETC1_RGB8_FORMAT) {
+        log_fmt("Texture |%s| compressed format 0x%x is not supported", ktx_path, ktx.gl_format);
+        supported = false;
+    }
+    if (!supported) {
+        unmap_file(&load->file);
+        return false;
+    }
+
+    load->width = ktx.levels[0].width;
+    load->height = ktx.levels[0].height;
+    load->level_count = ktx.level_count;
+    if (ktx.gl_type == 0 && !keep_compressed) {
+        decode_texture_etc1(load, &ktx);
+        unmap_file(&load->file);
+    } else {
+        load->format = ktx.gl_format;
+        load->type = ktx.gl_type;
+        memcpy(load->levels, ktx.levels, sizeof(ktx.levels));
+        load->mapped = true;
+    }
+    log_fmt("Texture |%s| w: %d h: %d levels: %d format: 0x%x%s", ktx_path, load->width, load->height,
+            load->level_count, load->format, load->level_block ? " (decoded)" : "");
+    return true;
+}
+
+void load_texture_job(LoaderItem *item) {
+    auto *load = (TextureLoad *) malloc(sizeof(TextureLoad));
+    memset(load, 0, sizeof(TextureLoad));
+
+    char ktx_path[LOADER_PATH_LENGTH];
+    texture_ktx_path(item->path, ktx_path, sizeof(ktx_path));
+    if (load_ktx_texture(load, ktx_path, has_etc1)) {
+        item->payload = load;
+        return;
+    }
+
+    load->pixels = decode_image(item->path, (item->flags & LOAD_TEXTURE_FLIP) != 0, &load->width, &load->height,
+                                &load->channels);
+    if (!load->pixels) {
+        // no payload, the placeholder stays
+        log_fmt("Texture |%s| could not be loaded", item->path);
+        free(load);
+        return;
+    }
+    log_fmt("Texture |%s| w: %d h: %d channels: %d", item->path, load->width, load->height, load->channels);
+
+    if ((item->flags & LOAD_TEXTURE_PREMULTIPLY) && load->channels == 4) {
+        pixels_premultiply_alpha(load->pixels, (size_t) load->width * load->height);
+    }
+
+    bool can_mip = has_npot_mips || image_is_power_of_two(load->width, load->height);
+    if ((item->flags & LOAD_TEXTURE_MIPMAPS) && can_mip) {
+        double start = loader_time_ms();
+        image_build_mips(load->pixels, load->width, load->height, load->channels,
+                         (item->flags & LOAD_TEXTURE_SRGB) != 0, &load->mips);
+        log_fmt("Texture |%s| %d mip levels, +%d bytes in %.2f ms", item->path, load->mips.level_count,
+                (int) load->mips.block_size, loader_time_ms() - start);
+    } else if (item->flags & LOAD_TEXTURE_MIPMAPS) {
+        log_fmt("Texture |%s| no mip levels, non power of two without GL_OES_texture_npot or ES 3", item->path);
+    }
+
+    if ((item->flags & LOAD_TEXTURE_COMPRESS) && has_etc1 && load->channels >= 3) {
+        if (!image_is_opaque(load->pixels, load->width, load->height, load->channels)) {
+            log_fmt("Texture |%s| ETC1 drops the alpha channel", item->path);
+        }
+        double start = loader_time_ms();
+        size_t uncompressed_size = (size_t) load->width * load->height * load->channels + load->mips.block_size;
+        compress_texture_etc1(load);
+        size_t compressed_size = 0;
+        for (int i = 0; i < load->level_count; ++i) {
+            compressed_size += load->levels[i].size;
+        }
+        log_fmt("Texture |%s| ETC1 %d -> %d bytes in %.2f ms", item->path, (int) uncompressed_size,
+                (int) compressed_size, loader_time_ms() - start);
+    } else if ((item->flags & LOAD_TEXTURE_LUMINANCE) ||
+               ((item->flags & (LOAD_TEXTURE_RGB565 | LOAD_TEXTURE_RGBA4444 | LOAD_TEXTURE_RGBA5551)) &&
+                load->channels >= 3)) {
+        double start = loader_time_ms();
+        size_t unpacked_size = (size_t) load->width * load->height * load->channels + load->mips.block_size;
+        pack_texture_levels(load, item->flags);
+        size_t packed_size = 0;
+        for (int i = 0; i < load->level_count; ++i) {
+            packed_size += load->levels[i].size;
+        }
+        log_fmt("Texture |%s| packed 0x%x %d -> %d bytes in %.2f ms", item->path, load->type, (int) unpacked_size,
+                (int) packed_size, loader_time_ms() - start);
+    } else {
+        texture_load_mip_levels(load);
+    }
+    item->payload = load;
+}
+
+// Streamed, the texture shows its small levels first
+void upload_texture_job(LoaderItem *item) {
+    auto *load = (TextureLoad *) item->payload;
+    if (!load) {
+        // nothing to load it again from
+        texture_budget_remove(&texture_budget, *(GLuint *) item->target);
+        return;
+    }
+    TextureSampler sampler = (item->flags & LOAD_TEXTURE_MIPMAPS) ? sampler_trilinear : sampler_bilinear;
+    texture_stream_start(&texture_streams, *(GLuint *) item->target, load->format, load->type, load->levels,
+                         load->level_count, sampler, release_texture_load, load);
+}
+
+// The placeholder texture name is the final one, the image is swapped in once it is decoded.
+// "<name>.ktx" next to the image is used instead when it exists (see tools/texture_convert).
+// flags are LOAD_TEXTURE_*, the KTX files have them baked in.
+void request_texture(GLuint *texture, const char *texture_path, int flags) {
+    *texture = prepare_placeholder_texture();
+    loader_submit(texture_path, load_texture_job, upload_texture_job, texture, flags);
+    texture_budget_add(&texture_budget, *texture, texture_path, load_texture_job, upload_texture_job, texture, flags);
+}
+
+// Atlas entries are composed on the CPU, each one ends up as a full chain of RGBA levels: its KTX file (ETC1
+// ones decoded) or the decoded image with the mip levels built here
+bool load_atlas_entry(TextureLoad *load, const AtlasEntry *entry) {
+    char ktx_path[LOADER_PATH_LENGTH];
+    texture_ktx_path(entry->path, ktx_path, sizeof(ktx_path));
+    if (load_ktx_texture(load, ktx_path, false)) {
+        if (load->format == GL_RGBA && load->type == GL_UNSIGNED_BYTE &&
+            load->level_count == image_level_count(load->width, load->height)) {
+            return true;
+        }
+        log_fmt("Texture |%s| is not a full RGBA chain, decoding %s for the atlas", ktx_path, entry->path);
+        free_texture_load(load);
+        memset(load, 0, sizeof(TextureLoad));
+    }
+
+    load->pixels = decode_image(entry->path, (entry->flags & LOAD_TEXTURE_FLIP) != 0, &load->width,
+                                &load->height, &load->channels, 4);
+    if (!load->pixels) {
+        return false;
+    }
+    image_build_mips(load->pixels, load->width, load->height, 4, (entry->flags & LOAD_TEXTURE_SRGB) != 0,
+                     &load->mips);
+    texture_load_mip_levels(load);
+    log_fmt("Texture |%s| w: %d h: %d, %d levels for the atlas", entry->path, load->width, load->height,
+            load->level_count);
+    return true;
+}
+
+typedef struct {
+    TextureLoad entries[ATLAS_MAX_ENTRIES];
+    AtlasRect rects[ATLAS_MAX_ENTRIES];
+    // false uploads the entries one by one
+    bool packed;
+    int width;
+    int height;
+    int level_count;
+    TextureLevel levels[IMAGE_MAX_LEVELS];
+    unsigned char *level_block;
+} AtlasLoad;
+
+typedef struct {
+    const TextureAtlas *atlas;
+    AtlasLoad *load;
+    bool loaded[ATLAS_MAX_ENTRIES];
+} AtlasEntriesJob;
+
+void load_atlas_entry_job(void *user, int index) {
+    auto *job = (AtlasEntriesJob *) user;
+    job->loaded[index] = load_atlas_entry(&job->load->entries[index], &job->atlas->entries[index]);
+}
+
+// Every level of the atlas is made of the same level of the entries, nothing is filtered across entries.
+// No payload when an entry can not be loaded, every region keeps the placeholder.
+void load_atlas_job(LoaderItem *item) {
+    auto *atlas = (TextureAtlas *) item->target;
+    auto *load = (AtlasLoad *) malloc(sizeof(AtlasLoad));
+    memset(load, 0, sizeof(AtlasLoad));
+
+    AtlasEntriesJob job = {atlas, load, {}};
+    jobs_parallel_for(atlas->entry_count, load_atlas_entry_job, &job);
+    for (int i = 0; i < atlas->entry_count; ++i) {
+        if (!job.loaded[i]) {
+            log_fmt("Atlas |%s| entry %s could not be loaded", item->path, atlas->entries[i].path);
+            for (int e = 0; e < atlas->entry_count; ++e) {
+                free_texture_load(&load->entries[e]);
+            }
+            free(load);
+            return;
+        }
+    }
+    item->payload = load;
+
+    for (int i = 0; i < atlas->entry_count; ++i) {
+        load->rects[i].width = load->entries[i].width;
+        load->rects[i].height = load->entries[i].height;
+    }
+    load->packed = atlas_pack(load->rects, atlas->entry_count, atlas->max_size, &load->width, &load->height);
+    if (!load->packed) {
+        log_fmt("Atlas |%s| the entries do not fit in %d x %d, uploading them one by one", item->path,
+                atlas->max_size, atlas->max_size);
+        return;
+    }
+
+    double start = loader_time_ms();
+    load->level_count = image_level_count(load->width, load->height);
+    size_t total_size = 0;
+    for (int i = 0; i < load->level_count; ++i) {
+        int width = load->width >> i ? load->width >> i : 1;
+        int height = load->height >> i ? load->height >> i : 1;
+        total_size += (size_t) width * height * 4;
+    }
+    // transparent black where there is no entry
+    load->level_block = (unsigned char *) calloc(total_size, 1);
+    size_t offset = 0;
+    for (int i = 0; i < load->level_count; ++i) {
+        TextureLevel *level = &load->levels[i];
+        level->width = load->width >> i ? load->width >> i : 1;
+        level->height = load->height >> i ? load->height >> i : 1;
+        level->data = load->level_block + offset;
+        level->size = (size_t) level->width * level->height * 4;
+        for (int e = 0; e < atlas->entry_count; ++e) {
+            const TextureLoad *entry = &load->entries[e];
+            // past its chain an entry stays 1 x 1
+            const TextureLevel *source = &entry->levels[i < entry->level_count ? i : entry->level_count - 1];
+            atlas_blit(load->level_block + offset, level->width, level->height, source->data, source->width,
+                       source->height, load->rects[e].x >> i, load->rects[e].y >> i, ATLAS_ALIGNMENT >> i);
+        }
+        offset += level->size;
+    }
+    for (int e = 0; e < atlas->entry_count; ++e) {
+        free_texture_load(&load->entries[e]);
+    }
+    log_fmt("Atlas |%s| %d entries in %d x %d, %.0f%% occupied, %d bytes in %.2f ms", item->path,
+            atlas->entry_count, load->width, load->height,
+            100.0f * atlas_occupancy(load->rects, atlas->entry_count, load->width, load->height),
+            (int) total_size, loader_time_ms() - start);
+}
+
+void release_atlas_load(void *payload) {
+    free(((AtlasLoad *) payload)->level_block);
+    free(payload);
+}
+
+void upload_atlas_job(LoaderItem *item) {
+    auto *atlas = (TextureAtlas *) item->target;
+    auto *load = (AtlasLoad *) item->payload;
+    if (!load) {
+        // nothing to load it again from
+        texture_budget_remove(&texture_budget, atlas->texture);
+        return;
+    }
+    if (load->packed) {
+        // the proportions of every level are the same, the regions hold while it streams
+        texture_stream_start(&texture_streams, atlas->texture, GL_RGBA, GL_UNSIGNED_BYTE, load->levels,
+                             load->level_count, sampler_atlas, release_atlas_load, load);
+        atlas->width = load->width;
+        atlas->height = load->height;
+        atlas->occupancy = atlas_occupancy(load->rects, atlas->entry_count, load->width, load->height);
+        for (int e = 0; e < atlas->entry_count; ++e) {
+            *atlas->entries[e].region = atlas_rect_region(atlas->texture, &load->rects[e], load->width,
+                                                          load->height);
+        }
+    } else {
+        for (int e = 0; e < atlas->entry_count; ++e) {
+            TextureLoad *entry = &load->entries[e];
+            GLuint texture = 0;
+            glGenTextures(1, &texture);
+            upload_texture_data(texture, GL_RGBA, GL_UNSIGNED_BYTE, entry->levels, entry->level_count,
+                                sampler_trilinear);
+            *atlas->entries[e].region = texture_region(texture);
+            free_texture_load(entry);
+        }
+        // the separate textures are not budgeted
+        texture_budget_remove(&texture_budget, atlas->texture);
+        gl_state_delete_texture(atlas->texture);
+        atlas->texture = 0;
+        free(load);
+    }
+}
+
+// flags are LOAD_TEXTURE_FLIP and LOAD_TEXTURE_SRGB, region is written when the atlas is uploaded
+void atlas_add(TextureAtlas *atlas, TextureRegion *region, const char *texture_path, int flags) {
+    assert(atlas->entry_count < ATLAS_MAX_ENTRIES);
+    AtlasEntry *entry = &atlas->entries[atlas->entry_count++];
+    snprintf(entry->path, sizeof(entry->path), "%s", texture_path);
+    entry->flags = flags;
+    entry->region = region;
+}
+
+// Loads the entries added with atlas_add into one texture, every region shows the placeholder until then
+void request_atlas(TextureAtlas *atlas, const char *name) {
+    GLint max_texture_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+    atlas->max_size = max_texture_size < ATLAS_MAX_SIZE ? max_texture_size : ATLAS_MAX_SIZE;
+    atlas->texture = prepare_placeholder_texture();
+    for (int e = 0; e < atlas->entry_count; ++e) {
+        *atlas->entries[e].region = texture_region(atlas->texture);
+    }
+    loader_submit(name, load_atlas_job, upload_atlas_job, atlas, 0);
+    texture_budget_add(&texture_budget, atlas->texture, name, load_atlas_job, upload_atlas_job, atlas, 0);
+}
+
+void load_model_job(LoaderItem *item) {
+    auto *model = (SModelData *) malloc(sizeof(SModelData));
+    *model = load_model(item->path);
+    item->payload = model;
+}
+
+// Static GL buffers for the vertices and indices, the copies in memory are released
+void upload_model_buffers(SModelData *model, const char *file_name) {
+    size_t vertex_size = smodel_vertex_data_size(model);
+    size_t index_size = (size_t) model->index_count * model->index_size;
+    GLuint buffers[2] = {0, 0};
+    glGenBuffers(model->index_count ? 2 : 1, buffers);
+    model->vertex_buffer = buffers[0];
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, model->vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, vertex_size, smodel_vertex_data(model), GL_STATIC_DRAW);
+    if (model->index_count) {
+        model->index_buffer = buffers[1];
+        // a bound vertex array object would record the element buffer
+        gl_state_bind_vertex_array(0);
+        gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, model->index_buffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_size, model->indices, GL_STATIC_DRAW);
+    }
+    GL_ERR;
+    log_fmt("%s: %d bytes of vertices and %d bytes of indices in GL buffers", file_name, (int) vertex_size,
+            (int) index_size);
+    smodel_release_vertices(model);
+}
+
+// Copies of the vertices and indices of an indexed model for render_model_instanced without instanced arrays, up
+// to MODEL_BATCH_INSTANCES instances per draw. Fewer copies when the vertices of all of them do not fit 16 bit
+// indices or MODEL_BATCH_MAX_KB, none when not even two do and every instance is a draw of its own.
+void upload_model_batch_buffers(SModelData *model, const char *file_name) {
+    size_t vertex_size = smodel_vertex_data_size(model);
+    uint32_t vertex_count = (uint32_t) model->vertex_number;
+    int copies = MODEL_BATCH_INSTANCES;
+    if (!has_32bit_indices && copies > (int) (65536 / vertex_count)) {
+        copies = (int) (65536 / vertex_count);
+    }
+    if ((size_t) copies * vertex_size > (size_t) MODEL_BATCH_MAX_KB * 1024) {
+        copies = (int) ((size_t) MODEL_BATCH_MAX_KB * 1024 / vertex_size);
+    }
+    if (!model->index_count || copies < 2) {
+        log_fmt("%s: no instance batches, %d vertices", file_name, model->vertex_number);
+        return;
+    }
+    int index_size = (size_t) copies * vertex_count > 65536 ? 4 : 2;
+
+    auto *vertices = (char *) malloc(vertex_size * copies);
+    auto *instance_indices = (uint8_t *) malloc((size_t) vertex_count * copies);
+    for (int k = 0; k < copies; ++k) {
+        memcpy(vertices + vertex_size * k, smodel_vertex_data(model), vertex_size);
+        memset(instance_indices + (size_t) vertex_count * k, k, vertex_count);
+    }
+    // the index ranges of the submodels and their detail levels cover the indices once, so each range is copied
+    // in place and a draw of n instances is the first n copies
+    auto *indices = (char *) calloc((size_t) model->index_count * copies, (size_t) index_size);
+    for (int s = 0; s < model->submodel_count; ++s) {
+        const SModelSubmodel *submodel = &model->submodels[s];
+        int lod_count = submodel->lod_count ? (int) submodel->lod_count : 1;
+        for (int lod = 0; lod < lod_count; ++lod) {
+            uint32_t first_index;
+            uint32_t index_count;
+            smodel_lod_range(submodel, lod, &first_index, &index_count);
+            for (int k = 0; k < copies; ++k) {
+                size_t destination = (size_t) first_index * copies + (size_t) index_count * k;
+                for (uint32_t i = 0; i < index_count; ++i) {
+                    uint32_t index = mesh_index(model, (int) (first_index + i)) + vertex_count * k;
+                    if (index_size == 2) {
+                        ((uint16_t *) indices)[destination + i] = (uint16_t) index;
+                    } else {
+                        ((uint32_t *) indices)[destination + i] = index;
+                    }
+                }
+            }
+        }
+    }
+
+    GLuint buffers[3];
+    glGenBuffers(3, buffers);
+    model->batch_vertex_buffer = buffers[0];
+    model->batch_instance_buffer = buffers[1];
+    model->batch_index_buffer = buffers[2];
+    model->batch_index_size = index_size;
+    model->batch_instances = copies;
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, model->batch_vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, vertex_size * copies, vertices, GL_STATIC_DRAW);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, model->batch_instance_buffer);
+    glBufferData(GL_ARRAY_BUFFER, (size_t) vertex_count * copies, instance_indices, GL_STATIC_DRAW);
+    gl_state_bind_vertex_array(0);
+    gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, model->batch_index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (size_t) model->index_count * copies * index_size, indices,
+                 GL_STATIC_DRAW);
+    GL_ERR;
+    log_fmt("%s: %d instances per batch, %d bytes of vertex and index copies in GL buffers", file_name, copies,
+            (int) ((vertex_size + vertex_count + (size_t) model->index_count * index_size) * copies));
+    free(vertices);
+    free(instance_indices);
+    free(indices);
+}
+
+void upload_model_job(LoaderItem *item) {
+    // the render thread only ever sees complete models, empty ones are skipped by render_model
+    auto *model = (SModelData *) item->target;
+    *model = *(SModelData *) item->payload;
+    free(item->payload);
+    if (!MODEL_CLIENT_ARRAYS && model->submodel_count) {
+        if ((item->flags & LOAD_MODEL_INSTANCED) && !has_instanced_arrays) {
+            upload_model_batch_buffers(model, item->path);
+        }
+        upload_model_buffers(model, item->path);
+    }
+}
+
+// flags are LOAD_MODEL_*
+void request_model(SModelData *model, const char *file_name, int flags = 0) {
+    memset(model, 0, sizeof(SModelData));
+    loader_submit(file_name, load_model_job, upload_model_job, model, flags);
+}
+
+void load_font_job(LoaderItem *item) {
+    auto *bake = (FontBake *) malloc(sizeof(FontBake));
+    *bake = font_bake();
+    item->payload = bake;
+}
+
+void upload_font_job(LoaderItem *item) {
+    *(FontData *) item->target = font_upload((FontBake *) item->payload);
+    free(item->payload);
+}
+
 void init_game(State *state, int w, int h) {
     log_str("init_game");
 
@@ -242,41 +1095,56 @@ void init_game(State *state, int w, int h) {
     screen_w = w;
     screen_h = h;
 
-    // GL state
+    jobs_init(0);
+    vfs_mount("assets" PACK_EXTENSION);
+    if (RUN_STARTUP_BENCHMARKS) {
+        benchmark_image_decode("tri_stormt_ao.png", 5);
+    }
+    loader_init(LOADER_PARALLEL_LOADS);
+    init_time_ms = loader_time_ms();
+    assets_ready = false;
+
+    // GL state, the context is new
+    gl_state_invalidate();
     log_fmt("Creating program: Main\n--------------");
-    state->main_shader_program = create_program(vs_textured_source, fs_textured_source);
+    shader_program_create(&model_shader, vs_textured_source, fs_textured_source);
+    state->main_shader_program = model_shader.program;
     gl_error("after create_program", __LINE__);
 
     log_fmt("Creating program: Font\n--------------");
-    font_shader_program = create_program(vs_font_source, fs_font_source);
+    shader_program_create(&font_shader, vs_font_source, fs_font_source);
     gl_error("after create_program", __LINE__);
 
     glViewport(0, 0, w, h);
     gl_error("after viewport", __LINE__);
 
-    // Load models
-    char *trooper = read_entire_file("tri_stormt.obj.smodel", 'r');
-    trooper_model = parse_smodel_file_as_single_model(trooper);
-
-    char *plane = read_entire_file("plane.obj.smodel", 'r');
-    plane_model = parse_smodel_file_as_single_model(plane);
-
-    char *sphere = read_entire_file("sphere.obj.smodel", 'r');
-    sphere_model = parse_smodel_file_as_single_model(sphere);
-
-    char *cube = read_entire_file("cube.obj.smodel", 'r');
-    cube_model = parse_smodel_file_as_single_model(cube);
-
-    char *duck = read_entire_file("duck.obj.smodel", 'r');
-    duck_model = parse_smodel_file_as_single_model(duck);
+    // Load models, in the background. Nothing is drawn for a model until it arrives.
+    has_32bit_indices = gl_has_extension("GL_OES_element_index_uint");
+    has_npot_mips = gl_has_npot_textures();
+    has_etc1 = gl_has_extension("GL_OES_compressed_ETC1_RGB8_texture");
+    bool es3 = gl_is_es3();
+    has_vertex_arrays = (es3 || gl_has_extension("GL_OES_vertex_array_object")) && gl_state_load_vertex_arrays(es3);
+    has_instanced_arrays = (es3 && gl_state_load_instanced_arrays("")) ||
+                           (gl_has_extension("GL_EXT_instanced_arrays") && gl_state_load_instanced_arrays("EXT")) ||
+                           (gl_has_extension("GL_ANGLE_instanced_arrays") && gl_state_load_instanced_arrays("ANGLE"));
+    log_fmt("NPOT mip levels %d GL_OES_compressed_ETC1_RGB8_texture %d vertex array objects %d instanced arrays %d",
+            has_npot_mips, has_etc1, has_vertex_arrays, has_instanced_arrays);
+    log_fmt("Creating program: Instanced\n--------------");
+    shader_program_create(&instanced_shader, has_instanced_arrays ? vs_instanced_source : vs_batched_source,
+                          fs_textured_source);
+    gl_error("after create_program", __LINE__);
+    if (has_instanced_arrays) {
+        glGenBuffers(1, &instance_buffer);
+    }
+    request_model(&trooper_model, "tri_stormt.obj.smodel", LOAD_MODEL_INSTANCED);
+    request_model(&plane_model, "plane.obj.smodel");
+    request_model(&sphere_model, "sphere.obj.smodel");
+    request_model(&cube_model, "cube.obj.smodel");
+    request_model(&duck_model, "duck.obj.smodel");
 
     //char *cube = read_entire_file("cube.obj.smodel", 'r');
     //char *cube = read_entire_file("plane.obj.smodel", 'r');
 
-    log_fmt("elements_per_vertex: %d vertex_number: %d size: %d has_data: %d",
-            trooper_model.elems_per_vertex, trooper_model.vertex_number, trooper_model.size,
-            trooper_model.data != nullptr);
-
     // Scenery positions
 
     float aspect = w / (float) h;
@@ -294,18 +1162,40 @@ void init_game(State *state, int w, int h) {
     log_fmt("Camera up %f %f %f\n", camera.up.x, camera.up.y, camera.up.z);
 
 
-    // Load images
-    trooper_texture = prepare_texture("tri_stormt_ao.png", true);
-    test_texture = prepare_texture("texture_map.png", true);
-    duck_texture = prepare_texture("duck.png", true);
-
-    font_data = font_init();
+    // Load images, placeholders until they are decoded
+    texture_budget_init(&texture_budget, (size_t) TEXTURE_BUDGET_MB * 1024 * 1024);
+    texture_streams_init(&texture_streams, &texture_budget);
+    // The small model textures share an atlas, the draws using either keep it bound. The ambient occlusion map
+    // is data, not colour.
+    memset(&model_atlas, 0, sizeof(model_atlas));
+    atlas_add(&model_atlas, &trooper_texture, "tri_stormt_ao.png", LOAD_TEXTURE_FLIP);
+    atlas_add(&model_atlas, &test_texture, "texture_map.png", LOAD_TEXTURE_FLIP | LOAD_TEXTURE_SRGB);
+    request_atlas(&model_atlas, "model_atlas");
+    duck_texture = texture_region(0);
+    // the textures of the atlas have transparent texels, ETC1 drops the alpha of the duck
+    trooper_material = {&model_shader, &trooper_texture, false};
+    trooper_instanced_material = {&instanced_shader, &trooper_texture, false};
+    test_material = {&model_shader, &test_texture, true};
+    duck_material = {&model_shader, &duck_texture, false};
+    request_texture(&duck_texture.texture, "duck.png",
+                    LOAD_TEXTURE_FLIP | LOAD_TEXTURE_MIPMAPS | LOAD_TEXTURE_SRGB | LOAD_TEXTURE_COMPRESS |
+                    LOAD_TEXTURE_RGB565);
+
+    memset(&font_data, 0, sizeof(font_data));
+    loader_submit("cmunrm.ttf", load_font_job, upload_font_job, &font_data, 0);
 
     line_renderer_init(&line_renderer, 2724);
 
     gl_error("end init_game", __LINE__);
 }
 
+// Low memory from the system. The textures the last frame did not draw are evicted and the rest lose levels until
+// they take half the budget, everything comes back from the asset pack when it is drawn again.
+void trim_memory_game() {
+    log_str("trim_memory_game");
+    texture_budget_trim(&texture_budget);
+}
+
 void transform_touch_screen_to_world(float3 *norm_ray_world, float tx, float ty) {
     // Touch positions must be already screen space(viewport coordinates) - normalized to screen width and in the range of -1,1 where 0,0 is the center of the screen
     // ((2.0f * x) / w) - 1.0f
@@ -353,62 +1243,323 @@ void update_touch_input_game(bool is_down, float in_touch_x, float in_touch_y) {
 void update_sensor_input_game(float in_yaw, float in_pitch, float in_roll) {
 }
 
-void render_model(GLuint shader, GLuint texture, SModelData *model, float model_matrix[],
-                  float view_matrix[],
-                  float projection_matrix[]) {
-    glUseProgram(shader);
+GLenum gl_component_type(uint8_t type) {
+    switch (type) {
+        case SMODEL_COMPONENT_SHORT:
+            return GL_SHORT;
+        case SMODEL_COMPONENT_UNSIGNED_SHORT:
+            return GL_UNSIGNED_SHORT;
+        case SMODEL_COMPONENT_BYTE:
+            return GL_BYTE;
+        default:
+            return GL_FLOAT;
+    }
+}
+
+void bind_model_attribute(GLint location, const SModelAttribute *attribute, GLsizei stride,
+                          const void *vertices) {
+    if (location < 0) {
+        return;
+    }
+    if (!attribute->components) {
+        gl_state_vertex_attrib_array(location, false);
+        return;
+    }
+    gl_state_vertex_attrib_array(location, true);
+    glVertexAttribPointer(location, attribute->components, gl_component_type(attribute->type),
+                          attribute->normalized ? GL_TRUE : GL_FALSE, stride,
+                          (const char *) vertices + attribute->offset);
+}
+
+// Program, depth and blend state and the texture of material, with the camera matrices
+void bind_material(const RenderMaterial *material, float view_matrix[], float projection_matrix[]) {
+    ShaderProgram *shader = material->shader;
+    gl_state_use_program(shader->program);
+    gl_state_depth_mask(true);
+    gl_state_enable(GL_DEPTH_TEST, true);
+    gl_state_depth_func(GL_LEQUAL);
+    gl_state_enable(GL_BLEND, material->blended);
+    if (material->blended) {
+        gl_state_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
     GL_ERR;
-    // Render cube
-    {
-        glActiveTexture(GL_TEXTURE0);
-        GL_ERR;
-        glBindTexture(GL_TEXTURE_2D, texture);
-        GL_ERR;
-        GLint texture_unit = glGetAttribLocation(shader,
-                                                 "texture_unit");
-        GL_ERR;
-        glUniform1f(texture_unit, 0.0);
-        GL_ERR;
-
-        glUniformMatrix4fv(
-                glGetUniformLocation(shader, "model_matrix"),
-                1,
-                GL_FALSE,
-                model_matrix);
-        glUniformMatrix4fv(
-                glGetUniformLocation(shader, "view_matrix"),
-                1,
-                GL_FALSE,
-                view_matrix);
-        glUniformMatrix4fv(
-                glGetUniformLocation(shader, "projection_matrix"),
-                1,
-                GL_FALSE, projection_matrix);
-
-        GLint position = glGetAttribLocation(shader,
-                                             "vertex_position");
-        GLint uvs = glGetAttribLocation(shader, "vertex_uvs");
-        int bytes_per_float = 4;
-        int stride = bytes_per_float * model->elems_stride;
-        glEnableVertexAttribArray(position);
-        glVertexAttribPointer(position, 3, GL_FLOAT, GL_FALSE, stride, model->data);
-        glEnableVertexAttribArray(uvs);
-        glVertexAttribPointer(uvs, 2, GL_FLOAT, GL_FALSE, stride, model->data + 3);
-        glDrawArrays(GL_TRIANGLES, 0, model->vertex_number);
+    gl_state_active_texture(0);
+    // draws sampling the same atlas keep it bound
+    texture_budget_touch(&texture_budget, material->texture->texture);
+    gl_state_bind_texture(material->texture->texture);
+    GL_ERR;
+    shader_set_int(shader, SHADER_UNIFORM_TEXTURE_UNIT, 0);
+    shader_set_mat4(shader, SHADER_UNIFORM_VIEW_MATRIX, view_matrix);
+    shader_set_mat4(shader, SHADER_UNIFORM_PROJECTION_MATRIX, projection_matrix);
+}
+
+// The vertex array object of model, or its buffers (client side arrays) on the default one
+void bind_model_vertices(SModelData *model, ShaderProgram *shader) {
+    if (model->vertex_array && model->vertex_array_program == shader->program) {
+        gl_state_bind_vertex_array(model->vertex_array);
+        return;
+    }
+    if (has_vertex_arrays && model->vertex_buffer && !model->vertex_array) {
+        // recorded by the first draw, with the attribute locations of its shader
+        gl_gen_vertex_arrays(1, &model->vertex_array);
+        model->vertex_array_program = shader->program;
+        gl_state_bind_vertex_array(model->vertex_array);
+    } else {
+        gl_state_bind_vertex_array(0);
+    }
+    // offsets into the buffers, or pointers into the client side arrays
+    const SModelVertexFormat *format = &model->vertex_format;
+    const void *vertices = model->vertex_buffer ? nullptr : smodel_vertex_data(model);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, model->vertex_buffer);
+    gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, model->index_buffer);
+    bind_model_attribute(shader->attributes[SHADER_ATTRIBUTE_POSITION], &format->position, format->stride, vertices);
+    bind_model_attribute(shader->attributes[SHADER_ATTRIBUTE_UVS], &format->uvs, format->stride, vertices);
+}
+
+// The vertex and instance index copies of upload_model_batch_buffers, on the default vertex array
+void bind_model_batch_vertices(SModelData *model, ShaderProgram *shader) {
+    const SModelVertexFormat *format = &model->vertex_format;
+    gl_state_bind_vertex_array(0);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, model->batch_vertex_buffer);
+    gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, model->batch_index_buffer);
+    bind_model_attribute(shader->attributes[SHADER_ATTRIBUTE_POSITION], &format->position, format->stride, nullptr);
+    bind_model_attribute(shader->attributes[SHADER_ATTRIBUTE_UVS], &format->uvs, format->stride, nullptr);
+    GLint location = shader->attributes[SHADER_ATTRIBUTE_INSTANCE_INDEX];
+    if (location >= 0) {
+        gl_state_bind_buffer(GL_ARRAY_BUFFER, model->batch_instance_buffer);
+        gl_state_vertex_attrib_array(location, true);
+        glVertexAttribPointer(location, 1, GL_UNSIGNED_BYTE, GL_FALSE, 0, nullptr);
+    }
+}
+
+// Dequantization of the submodel vertices into the texture region
+void set_submodel_uniforms(ShaderProgram *shader, const SModelData *model, const SModelSubmodel *submodel,
+                           const TextureRegion *texture) {
+    float decode_position_offset[3];
+    float decode_position_scale[3];
+    float decode_uv_offset[2];
+    float decode_uv_scale[2];
+    smodel_decode_transform(model, submodel, decode_position_offset, decode_position_scale, decode_uv_offset,
+                            decode_uv_scale);
+    // into the region of the texture, the UVs of the model stay in [0, 1]
+    for (int c = 0; c < 2; ++c) {
+        decode_uv_offset[c] = texture->uv_offset[c] + decode_uv_offset[c] * texture->uv_scale[c];
+        decode_uv_scale[c] *= texture->uv_scale[c];
+    }
+    shader_set_vec3(shader, SHADER_UNIFORM_POSITION_OFFSET, decode_position_offset);
+    shader_set_vec3(shader, SHADER_UNIFORM_POSITION_SCALE, decode_position_scale);
+    shader_set_vec2(shader, SHADER_UNIFORM_UV_OFFSET, decode_uv_offset);
+    shader_set_vec2(shader, SHADER_UNIFORM_UV_SCALE, decode_uv_scale);
+}
+
+// instance_count > 0 draws that many instances with instanced arrays
+void draw_submodel(const SModelData *model, const SModelSubmodel *submodel, int lod, int instance_count = 0) {
+    model_draw_calls++;
+    if (model->index_count) {
+        uint32_t first_index;
+        uint32_t index_count;
+        smodel_lod_range(submodel, lod, &first_index, &index_count);
+        GLenum index_type = model->index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        const char *indices = model->index_buffer ? nullptr : (const char *) model->indices;
+        indices += first_index * model->index_size;
+        if (instance_count) {
+            gl_draw_elements_instanced(GL_TRIANGLES, index_count, index_type, indices, instance_count);
+        } else {
+            glDrawElements(GL_TRIANGLES, index_count, index_type, indices);
+        }
+    } else if (instance_count) {
+        gl_draw_arrays_instanced(GL_TRIANGLES, submodel->first_vertex, submodel->vertex_count, instance_count);
+    } else {
+        glDrawArrays(GL_TRIANGLES, submodel->first_vertex, submodel->vertex_count);
+    }
+}
+
+void render_model(const RenderMaterial *material, SModelData *model, const float model_matrix[],
+                  float view_matrix[], float projection_matrix[], int *lod) {
+    if (model->submodel_count == 0) {
+        // still loading
+        return;
+    }
+    ShaderProgram *shader = material->shader;
+    model_draws++;
+    bind_material(material, view_matrix, projection_matrix);
+    shader_set_mat4(shader, SHADER_UNIFORM_MODEL_MATRIX, model_matrix);
+    bind_model_vertices(model, shader);
+
+    float view_projection[] = M_MAT4_IDENTITY();
+    float model_view_projection[] = M_MAT4_IDENTITY();
+    m_mat4_mul(view_projection, projection_matrix, view_matrix);
+    m_mat4_mul(model_view_projection, view_projection, model_matrix);
+
+    // @note the model matrix scale is not part of the error, scaled down models stay a bit more detailed
+    *lod = mesh_select_lod(model, *lod, model_view_projection, projection_matrix[5] * screen_h * 0.5f);
+
+    // Each submodel is culled and drawn on its own
+    for (int i = 0; i < model->submodel_count; ++i) {
+        SModelSubmodel *submodel = &model->submodels[i];
+        if (aabb_outside_frustum(model_view_projection, submodel->aabb_min, submodel->aabb_max)) {
+            continue;
+        }
+        set_submodel_uniforms(shader, model, submodel, material->texture);
+        draw_submodel(model, submodel, *lod);
     }
     GL_ERR;
-    glUseProgram(0);
+}
 
-    glDepthMask(GL_TRUE);
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LEQUAL);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+// The instances of a detail level at instance_matrices[first], each submodel once for all of them
+void draw_instances(const RenderMaterial *material, SModelData *model, int lod, int first, int count) {
+    ShaderProgram *shader = material->shader;
+    GLint location = shader->attributes[SHADER_ATTRIBUTE_INSTANCE_MATRIX];
+    assert(location >= 0 && location + 3 < GL_STATE_VERTEX_ATTRIBUTES);
+    bind_model_vertices(model, shader);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, instance_buffer);
+    // a mat4 attribute is a vec4 per column
+    for (int column = 0; column < 4; ++column) {
+        gl_state_vertex_attrib_array(location + column, true);
+        gl_state_vertex_attrib_divisor(location + column, true);
+        glVertexAttribPointer(location + column, 4, GL_FLOAT, GL_FALSE, sizeof(float) * 16,
+                              (const char *) nullptr + sizeof(float) * (first * 16 + column * 4));
+    }
+    for (int i = 0; i < model->submodel_count; ++i) {
+        const SModelSubmodel *submodel = &model->submodels[i];
+        set_submodel_uniforms(shader, model, submodel, material->texture);
+        draw_submodel(model, submodel, lod, count);
+    }
+}
+
+// draw_instances without instanced arrays, batches of up to batch_instances share a draw through the uniform array
+void draw_instance_batches(const RenderMaterial *material, SModelData *model, int lod, int first, int count) {
+    ShaderProgram *shader = material->shader;
+    int batch_size = model->batch_instances > 1 ? model->batch_instances : 1;
+    if (batch_size > 1) {
+        bind_model_batch_vertices(model, shader);
+    } else {
+        // one instance per draw, all vertices have instance index 0
+        bind_model_vertices(model, shader);
+        GLint location = shader->attributes[SHADER_ATTRIBUTE_INSTANCE_INDEX];
+        if (location >= 0) {
+            gl_state_vertex_attrib_array(location, false);
+            glVertexAttrib1f(location, 0.0f);
+        }
+    }
+    GLenum index_type = model->batch_index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    for (int start = first; start < first + count; start += batch_size) {
+        int instances = first + count - start < batch_size ? first + count - start : batch_size;
+        shader_set_mat4_array(shader, SHADER_UNIFORM_INSTANCE_MATRICES, &instance_matrices[start * 16], instances);
+        for (int i = 0; i < model->submodel_count; ++i) {
+            const SModelSubmodel *submodel = &model->submodels[i];
+            set_submodel_uniforms(shader, model, submodel, material->texture);
+            if (batch_size == 1) {
+                draw_submodel(model, submodel, lod);
+                continue;
+            }
+            uint32_t first_index;
+            uint32_t index_count;
+            smodel_lod_range(submodel, lod, &first_index, &index_count);
+            model_draw_calls++;
+            glDrawElements(GL_TRIANGLES, index_count * instances, index_type,
+                           (const char *) nullptr + (size_t) first_index * batch_size * model->batch_index_size);
+        }
+    }
+}
+
+// count copies of model, transforms holds a model matrix per instance and lods the detail level of each (see
+// render_model). Instances are culled as a whole and grouped by detail level, the draw calls only grow with the
+// levels and submodels. Without instanced arrays groups of more than model->batch_instances take more draws.
+void render_model_instanced(const RenderMaterial *material, SModelData *model, const float *transforms, int count,
+                            float view_matrix[], float projection_matrix[], int *lods) {
+    if (model->submodel_count == 0) {
+        // still loading
+        return;
+    }
+    assert(count <= MODEL_MAX_INSTANCES);
+    bind_material(material, view_matrix, projection_matrix);
+
+    // bounds of the whole model
+    float aabb_min[3];
+    float aabb_max[3];
+    for (int c = 0; c < 3; ++c) {
+        aabb_min[c] = model->submodels[0].aabb_min[c];
+        aabb_max[c] = model->submodels[0].aabb_max[c];
+        for (int i = 1; i < model->submodel_count; ++i) {
+            aabb_min[c] = fminf(aabb_min[c], model->submodels[i].aabb_min[c]);
+            aabb_max[c] = fmaxf(aabb_max[c], model->submodels[i].aabb_max[c]);
+        }
+    }
+
+    float view_projection[] = M_MAT4_IDENTITY();
+    m_mat4_mul(view_projection, projection_matrix, view_matrix);
+    int level_counts[SMODEL_MAX_LODS] = {0};
+    int visible[MODEL_MAX_INSTANCES];
+    int visible_count = 0;
+    for (int i = 0; i < count; ++i) {
+        float model_view_projection[] = M_MAT4_IDENTITY();
+        m_mat4_mul(model_view_projection, view_projection, transforms + i * 16);
+        lods[i] = mesh_select_lod(model, lods[i], model_view_projection, projection_matrix[5] * screen_h * 0.5f);
+        assert(lods[i] >= 0 && lods[i] < SMODEL_MAX_LODS);
+        if (aabb_outside_frustum(model_view_projection, aabb_min, aabb_max)) {
+            continue;
+        }
+        visible[visible_count++] = i;
+        level_counts[lods[i]]++;
+    }
+    model_draws += visible_count;
+    if (!visible_count) {
+        return;
+    }
+
+    // the matrices of the visible instances, grouped by detail level
+    int level_starts[SMODEL_MAX_LODS];
+    int start = 0;
+    for (int lod = 0; lod < SMODEL_MAX_LODS; ++lod) {
+        level_starts[lod] = start;
+        start += level_counts[lod];
+    }
+    for (int i = 0; i < visible_count; ++i) {
+        int instance = visible[i];
+        memcpy(&instance_matrices[level_starts[lods[instance]]++ * 16], transforms + instance * 16,
+               sizeof(float) * 16);
+    }
+    if (has_instanced_arrays) {
+        gl_state_bind_buffer(GL_ARRAY_BUFFER, instance_buffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 16 * visible_count, instance_matrices, GL_STREAM_DRAW);
+    }
+
+    for (int lod = 0, first = 0; lod < SMODEL_MAX_LODS; first += level_counts[lod++]) {
+        if (!level_counts[lod]) {
+            continue;
+        }
+        if (has_instanced_arrays) {
+            draw_instances(material, model, lod, first, level_counts[lod]);
+        } else {
+            draw_instance_batches(material, model, lod, first, level_counts[lod]);
+        }
+    }
+
+    // the default vertex array is shared with the other renderers, a model vertex array object keeps its divisors
+    ShaderProgram *shader = material->shader;
+    bool own_vertex_array = model->vertex_array && model->vertex_array_program == shader->program;
+    if (has_instanced_arrays && !own_vertex_array) {
+        GLint location = shader->attributes[SHADER_ATTRIBUTE_INSTANCE_MATRIX];
+        for (int column = 0; column < 4; ++column) {
+            gl_state_vertex_attrib_divisor(location + column, false);
+            gl_state_vertex_attrib_array(location + column, false);
+        }
+    }
+    GL_ERR;
 }
 
 void render_game(State *state) {
     render_tick += 0.01f;
 
+    loader_drain(LOADER_FRAME_BUDGET_MS);
+    texture_streams_update(&texture_streams, (size_t) TEXTURE_STREAM_FRAME_KB * 1024);
+    if (!assets_ready && loader_pending() == 0 && texture_streams.count == 0) {
+        assets_ready = true;
+        log_fmt("assets ready %.2f ms after init_game (parallel loads %d, %d workers)",
+                loader_time_ms() - init_time_ms, LOADER_PARALLEL_LOADS, jobs_worker_count());
+    }
+
     if (touch_is_down) {
         float camera_nudge = 10.01f;
         update_camera(&camera, view_matrix, camera.position.x, camera.position.y,
@@ -429,9 +1580,12 @@ void render_game(State *state) {
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
     GL_ERR;
 
-    glUseProgram(state->main_shader_program);
+    gl_state_use_program(state->main_shader_program);
     GL_ERR;
 
+    model_draws = 0;
+    model_draw_calls = 0;
+    render_queue_clear(&render_queue);
     if (RENDER_MODELS) {
         // Plane
         m_mat4_identity(model_matrix);
@@ -448,8 +1602,8 @@ void render_game(State *state) {
         m_mat4_scale(scale_matrix, &scale);
         m_mat4_mul(model_matrix, model_matrix, scale_matrix);
 
-        render_model(state->main_shader_program, trooper_texture, &plane_model, model_matrix,
-                     view_matrix, projection_matrix);
+        render_queue_submit(&render_queue, &plane_model, &trooper_material, model_matrix, &plane_lods[0],
+                            RENDER_LAYER_WORLD, view_matrix);
 
         // Plane
         set_float3(&translation, 0, 4.0f, 0.0);
@@ -463,51 +1617,74 @@ void render_game(State *state) {
         m_mat4_scale(scale_matrix, &scale);
         m_mat4_mul(model_matrix, model_matrix, scale_matrix);
 
-        render_model(state->main_shader_program, test_texture, &plane_model,
-                     model_matrix, view_matrix, projection_matrix);
+        render_queue_submit(&render_queue, &plane_model, &test_material, model_matrix, &plane_lods[1],
+                            RENDER_LAYER_WORLD, view_matrix);
 
         // Sphere
         set_float3(&translation, -4.0f, 0.0f, 0.0);
         m_mat4_identity(model_matrix);
         m_mat4_translation(model_matrix, &translation);
-        render_model(state->main_shader_program, test_texture, &sphere_model, model_matrix,
-                     view_matrix, projection_matrix);
+        render_queue_submit(&render_queue, &sphere_model, &test_material, model_matrix, &sphere_lod,
+                            RENDER_LAYER_WORLD, view_matrix);
 
         // Cube
         set_float3(&translation, touch_ray_world.z, touch_ray_world.y, touch_ray_world.z);
         m_mat4_identity(model_matrix);
         m_mat4_translation(model_matrix, &translation);
-        render_model(state->main_shader_program, test_texture, &cube_model, model_matrix,
-                     view_matrix, projection_matrix);
+        render_queue_submit(&render_queue, &cube_model, &test_material, model_matrix, &cube_lod, RENDER_LAYER_WORLD,
+                            view_matrix);
 
         // Duck
         set_float3(&translation, 6.0f, 0.0f, 6.0);
         m_mat4_identity(model_matrix);
         m_mat4_translation(model_matrix, &translation);
-        render_model(state->main_shader_program, duck_texture, &duck_model, model_matrix,
-                     view_matrix, projection_matrix);
+        render_queue_submit(&render_queue, &duck_model, &duck_material, model_matrix, &duck_lod, RENDER_LAYER_WORLD,
+                            view_matrix);
 
-        // Trooper
+        // Trooper, the whole grid in one instanced packet
         float offset_space = 1.8f;
-        float gx = 1.0f;
-        float gy = 1.0f;
-        for (float cy = -gy; cy < gy; cy += offset_space) {
-            for (float cx = -gx; cx < gx; cx += offset_space) {
-                float x = cx;
+        float trooper_transforms[TROOPER_INSTANCES * 16];
+        for (int row = 0; row < TROOPER_GRID; ++row) {
+            for (int column = 0; column < TROOPER_GRID; ++column) {
+                float x = -1.0f + column * offset_space;
                 float y = touch_model_trans.y;
-                float z = cy;
+                float z = -1.0f + row * offset_space;
                 set_float3(&touch_model_trans, x, y, z);
 
-                m_mat4_identity(model_matrix);
-                m_mat4_rotation_axis(model_matrix, &Y_AXIS, render_tick);
-                m_mat4_translation(model_matrix, &touch_model_trans);
-
-                render_model(state->main_shader_program, trooper_texture, &trooper_model,
-                             model_matrix, view_matrix, projection_matrix);
+                float *transform = &trooper_transforms[(row * TROOPER_GRID + column) * 16];
+                m_mat4_identity(transform);
+                m_mat4_rotation_axis(transform, &Y_AXIS, render_tick);
+                m_mat4_translation(transform, &touch_model_trans);
+            }
+        }
+        render_queue_submit_instanced(&render_queue, &trooper_model, &trooper_instanced_material, trooper_transforms,
+                                      TROOPER_INSTANCES, trooper_lods, RENDER_LAYER_WORLD, view_matrix);
+
+        render_queue_sort(&render_queue);
+        for (int i = 0; i < render_queue.count; ++i) {
+            const RenderPacket *packet = render_queue_packet(&render_queue, i);
+            if (packet->instances) {
+                render_model_instanced(packet->material, packet->mesh, packet->instances, packet->instance_count,
+                                       view_matrix, projection_matrix, packet->lod);
+            } else {
+                render_model(packet->material, packet->mesh, packet->transform, view_matrix, projection_matrix,
+                             packet->lod);
             }
         }
     }
-    glUseProgram(0);
+    texture_budget_end_frame(&texture_budget);
+    if (++frame_count % RENDER_STATS_FRAMES == 0) {
+        const GlStateStats *gl_stats = gl_state_frame_stats();
+        log_fmt("frame %d: %d model draws in %d draw calls, %d texture binds. Atlas %d x %d, %.0f%% occupied",
+                frame_count, model_draws, model_draw_calls, gl_stats->issued[GL_STATE_BIND_TEXTURE],
+                model_atlas.width, model_atlas.height, 100.0f * model_atlas.occupancy);
+        gl_state_log_stats(gl_stats);
+        log_fmt("texture budget: %d / %d KB, %d evictions, %d dropped levels, %d reloads",
+                (int) (texture_budget_resident(&texture_budget) / 1024), (int) (texture_budget.budget / 1024),
+                texture_budget.evictions, texture_budget.dropped_levels, texture_budget.reloads);
+        log_fmt("model shader: %d uniform uploads, %d skipped as unchanged", model_shader.uniform_uploads,
+                model_shader.uniform_skips);
+    }
 
     m_mat4_identity(model_matrix);
     line_renderer_clear_lines(&line_renderer);
@@ -526,8 +1703,8 @@ void render_game(State *state) {
     line_renderer_render(&line_renderer, model_matrix, view_matrix, projection_matrix);
 
     {
-        glDisable(GL_CULL_FACE);
-        glUseProgram(font_shader_program);
+        gl_state_enable(GL_CULL_FACE, false);
+        gl_state_use_program(font_shader.program);
 
         float3 translation;
         float3 scale;
@@ -538,12 +1715,13 @@ void render_game(State *state) {
         m_mat4_mul(model_matrix, model_matrix, rotation_matrix);
         char buf[500];
         sprintf(buf, "Hi::%f", render_tick);
-        font_render(font_data, 0, 0, buf, font_shader_program, model_matrix, view_matrix,
+        font_render(font_data, 0, 0, buf, &font_shader, model_matrix, view_matrix,
                     projection_matrix);
-        glEnable(GL_CULL_FACE);
+        gl_state_enable(GL_CULL_FACE, true);
     }
 
-    glUseProgram(0);
+    gl_state_use_program(0);
+    gl_state_end_frame();
 
     GL_ERR;
 }
\ No newline at end of file
@@ -47,4 +47,7 @@ void update_sensor_input_game(float yaw, float pitch, float roll);
 
 void render_game(State *state);
 
+// GL context current, between frames
+void trim_memory_game();
+
 #endif //BLOCKS_GAME_H
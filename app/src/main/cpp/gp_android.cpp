@@ -2,6 +2,11 @@
 // Created by Gonçalo Palaio on 2019-09-12.
 //
 
+#include <cstdint>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "gp_platform.h"
 #include "gp_android.h"
 
 AAssetManager *asset_manager;
@@ -31,7 +36,8 @@ char *android_read_entire_file(const char *file_name, char mode) {
 
     AAsset *file = AAssetManager_open(asset_manager, file_name, AASSET_MODE_BUFFER);
     auto fileLength = static_cast<size_t>(AAsset_getLength(file));
-    char *fileContent = new char[fileLength + 1];
+    // malloc, the callers release it with free
+    char *fileContent = (char *) malloc(fileLength + 1);
     AAsset_read(file, fileContent, fileLength);
     AAsset_close(file);
 
@@ -40,6 +46,84 @@ char *android_read_entire_file(const char *file_name, char mode) {
     return fileContent;
 }
 
+bool android_map_file(const char *file_name, FileView *view) {
+    assert(asset_manager);
+    view->data = nullptr;
+    view->size = 0;
+    view->handle = nullptr;
+
+    AAsset *file = AAssetManager_open(asset_manager, file_name, AASSET_MODE_BUFFER);
+    if (!file) {
+        return false;
+    }
+
+    // Assets stored uncompressed in the apk (see noCompress in build.gradle) are mapped straight from it
+    off_t start;
+    off_t length;
+    int fd = AAsset_openFileDescriptor(file, &start, &length);
+    if (fd >= 0) {
+        long page_size = sysconf(_SC_PAGESIZE);
+        off_t page_start = start - start % page_size;
+        size_t page_offset = (size_t) (start - page_start);
+        void *base = mmap(nullptr, (size_t) length + page_offset, PROT_READ, MAP_PRIVATE, fd, page_start);
+        close(fd);
+        if (base != MAP_FAILED) {
+            AAsset_close(file);
+            view->data = (const char *) base + page_offset;
+            view->size = (size_t) length;
+            return true;
+        }
+    }
+
+    // otherwise AAsset_getBuffer inflates the asset into memory owned by the AAsset.
+    const void *buffer = AAsset_getBuffer(file);
+    if (!buffer) {
+        AAsset_close(file);
+        return false;
+    }
+
+    view->data = buffer;
+    view->size = static_cast<size_t>(AAsset_getLength(file));
+    view->handle = file;
+    return true;
+}
+
+void android_unmap_file(FileView *view) {
+    if (view->handle) {
+        AAsset_close((AAsset *) view->handle);
+    } else if (view->data) {
+        // mmap'ed, the mapping starts at the page holding data
+        long page_size = sysconf(_SC_PAGESIZE);
+        auto address = (uintptr_t) view->data;
+        uintptr_t base = address - address % page_size;
+        munmap((void *) base, view->size + (address - base));
+    }
+    view->data = nullptr;
+    view->size = 0;
+    view->handle = nullptr;
+}
+
+static int android_reader_read(void *handle, char *buffer, int size) {
+    int read = AAsset_read((AAsset *) handle, buffer, (size_t) size);
+    return read >= 0 ? read : -1;
+}
+
+static void android_reader_close(void *handle) {
+    AAsset_close((AAsset *) handle);
+}
+
+bool android_open_file_reader(const char *file_name, FileReader *reader) {
+    assert(asset_manager);
+    AAsset *file = AAssetManager_open(asset_manager, file_name, AASSET_MODE_STREAMING);
+    if (!file) {
+        return false;
+    }
+    reader->handle = file;
+    reader->read = android_reader_read;
+    reader->close = android_reader_close;
+    return true;
+}
+
 void android_log_files_in_folder(const char *text) {
     AAssetDir *assetDir = AAssetManager_openDir(asset_manager, "");
     const char *filename = (const char *) nullptr;
@@ -68,17 +152,11 @@ static int android_file_close(void* cookie) {
     return 0;
 }
 
-FILE* android_file_open(const char* fname, const char* mode)
-{
-    android_log_fmt("game_blocks: Calling android_file_open %s", fname);
-
-    if(mode[0] == 'w'){
-#undef  fopen
-        return fopen(fname,mode);
+FILE *android_open_asset_stdio(const char *file_name) {
+    android_log_fmt("game_blocks: Calling android_open_asset_stdio %s", file_name);
+    AAsset *asset = AAssetManager_open(asset_manager, file_name, AASSET_MODE_STREAMING);
+    if (!asset) {
+        return nullptr;
     }
-#define fopen(name, mode) android_fopen(name, mode)
-    AAsset* asset = AAssetManager_open(asset_manager, fname, 0);
-    if(asset) return funopen(asset, android_file_read, android_file_write, android_file_seek, android_file_close);
-#undef  fopen
-    return fopen(fname,mode);
+    return funopen(asset, android_file_read, android_file_write, android_file_seek, android_file_close);
 }
@@ -14,11 +14,14 @@
 
 #include "stb_sprintf.h"
 
-FILE* android_file_open(const char* fname, const char* mode);
-#define fopen(name, mode) android_file_open(name, mode)
-
+// Images are decoded on several threads at once, the failure string is a global stb_image 2.23 writes unguarded.
+// Without the strings its setter stbi__err is never called.
+#define STBI_NO_FAILURE_STRINGS
 #define STB_IMAGE_IMPLEMENTATION
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
 #include "stb_image.h"
+#pragma GCC diagnostic pop
 
 #define  LOG_TAG    "game_blocks"
 #define  LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
@@ -0,0 +1,148 @@
+//
+// Texture atlases. Small model textures are packed (stb_rect_pack) into one texture so consecutive draws keep it
+// bound, each draw maps its [0, 1] UVs into its entry with a scale and offset (see TextureRegion).
+//
+// Entries start on multiples of ATLAS_ALIGNMENT texels so their mip levels line up with the atlas levels, and
+// every level has its edges repeated into a gutter so bilinear filtering and the coarser levels do not pick up
+// the neighbours. Models sampling an atlas entry must keep their UVs inside [0, 1], nothing wraps.
+//
+
+#ifndef BLOCKS_GP_ATLAS_H
+#define BLOCKS_GP_ATLAS_H
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include "gp_loader.h"
+
+#define ATLAS_MAX_ENTRIES 8
+// Grid of the placement and width of the gutter around each entry at level 0, halved with every level
+#define ATLAS_ALIGNMENT 8
+#define ATLAS_MIN_SIZE 64
+
+// What a draw samples, uv' = uv_offset + uv * uv_scale
+typedef struct {
+    GLuint texture;
+    float uv_scale[2];
+    float uv_offset[2];
+} TextureRegion;
+
+typedef struct {
+    char path[LOADER_PATH_LENGTH];
+    // LOAD_TEXTURE_*, the atlas is always mip mapped and never compressed
+    int flags;
+    // owned by the caller, filled in when the atlas is uploaded
+    TextureRegion *region;
+} AtlasEntry;
+
+typedef struct {
+    GLuint texture;
+    // GL_MAX_TEXTURE_SIZE or less
+    int max_size;
+    int entry_count;
+    AtlasEntry entries[ATLAS_MAX_ENTRIES];
+    // once uploaded
+    int width;
+    int height;
+    float occupancy;
+} TextureAtlas;
+
+// Where an entry landed, texels of level 0
+typedef struct {
+    int width;
+    int height;
+    int x;
+    int y;
+} AtlasRect;
+
+// The whole texture
+TextureRegion texture_region(GLuint texture) {
+    TextureRegion region = {texture, {1.0f, 1.0f}, {0.0f, 0.0f}};
+    return region;
+}
+
+TextureRegion atlas_rect_region(GLuint texture, const AtlasRect *rect, int atlas_width, int atlas_height) {
+    TextureRegion region;
+    region.texture = texture;
+    region.uv_scale[0] = rect->width / (float) atlas_width;
+    region.uv_scale[1] = rect->height / (float) atlas_height;
+    region.uv_offset[0] = rect->x / (float) atlas_width;
+    region.uv_offset[1] = rect->y / (float) atlas_height;
+    return region;
+}
+
+// Places rects (width and height set) in the smallest power of two atlas, at most max_size on each side, that
+// takes them all. Returns false when they do not fit.
+// @note Packed in cells of ATLAS_ALIGNMENT texels, each rect is one cell larger on every side for its gutter.
+// The packing area is one cell larger on every side as well, the gutters of entries at the atlas edges are cut.
+bool atlas_pack(AtlasRect *rects, int count, int max_size, int *atlas_width, int *atlas_height) {
+    assert(count <= ATLAS_MAX_ENTRIES);
+    stbrp_rect cells[ATLAS_MAX_ENTRIES];
+    for (int i = 0; i < count; ++i) {
+        cells[i].id = i;
+        cells[i].w = (rects[i].width + ATLAS_ALIGNMENT - 1) / ATLAS_ALIGNMENT + 2;
+        cells[i].h = (rects[i].height + ATLAS_ALIGNMENT - 1) / ATLAS_ALIGNMENT + 2;
+    }
+
+    int node_count = max_size / ATLAS_ALIGNMENT + 2;
+    auto *nodes = (stbrp_node *) malloc(sizeof(stbrp_node) * node_count);
+    bool packed = false;
+    // increasing area, w x w / 2 then w x w
+    for (int width = ATLAS_MIN_SIZE; width <= max_size && !packed; width *= 2) {
+        for (int height = width / 2; height <= width && !packed; height *= 2) {
+            stbrp_context context;
+            stbrp_init_target(&context, width / ATLAS_ALIGNMENT + 2, height / ATLAS_ALIGNMENT + 2, nodes,
+                              node_count);
+            packed = stbrp_pack_rects(&context, cells, count) != 0;
+            *atlas_width = width;
+            *atlas_height = height;
+        }
+    }
+    free(nodes);
+    if (!packed) {
+        return false;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        // the gutter cell before the entry is the one cut off the packing area
+        rects[i].x = cells[i].x * ATLAS_ALIGNMENT;
+        rects[i].y = cells[i].y * ATLAS_ALIGNMENT;
+    }
+    return true;
+}
+
+// Share of the atlas covered by entries
+float atlas_occupancy(const AtlasRect *rects, int count, int atlas_width, int atlas_height) {
+    double area = 0;
+    for (int i = 0; i < count; ++i) {
+        area += (double) rects[i].width * rects[i].height;
+    }
+    return (float) (area / ((double) atlas_width * atlas_height));
+}
+
+// Copies a width x height RGBA level to (x, y) of an RGBA atlas level, with its edge texels repeated gutter
+// texels out on every side. The level must fit, the gutter is cut at the atlas edges.
+void atlas_blit(unsigned char *atlas, int atlas_width, int atlas_height, const unsigned char *pixels, int width,
+                int height, int x, int y, int gutter) {
+    assert(x >= 0 && y >= 0 && x + width <= atlas_width && y + height <= atlas_height);
+    int first_column = x - gutter < 0 ? -x : -gutter;
+    int end_column = x + width + gutter > atlas_width ? atlas_width - x : width + gutter;
+    for (int row = -gutter; row < height + gutter; ++row) {
+        if (y + row < 0 || y + row >= atlas_height) {
+            continue;
+        }
+        int source_row = row < 0 ? 0 : row >= height ? height - 1 : row;
+        const unsigned char *source = pixels + (size_t) source_row * width * 4;
+        unsigned char *destination = atlas + ((size_t) (y + row) * atlas_width + x) * 4;
+        for (int column = first_column; column < 0; ++column) {
+            memcpy(destination + column * 4, source, 4);
+        }
+        memcpy(destination, source, (size_t) width * 4);
+        for (int column = width; column < end_column; ++column) {
+            memcpy(destination + column * 4, source + (width - 1) * 4, 4);
+        }
+    }
+}
+
+#endif //BLOCKS_GP_ATLAS_H
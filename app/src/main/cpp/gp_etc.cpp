@@ -0,0 +1,328 @@
+//
+// ETC1 encoder and decoder, see gp_etc.h and the OES_compressed_ETC1_RGB8_texture specification
+//
+
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+
+#include "gp_jobs.h"
+#include "gp_etc.h"
+
+// Intensity modifiers per table, the texel indices pick +small, +large, -small, -large
+static const int etc1_modifiers[8][2] = {
+        {2,  8},
+        {5,  17},
+        {9,  29},
+        {13, 42},
+        {18, 60},
+        {24, 80},
+        {33, 106},
+        {47, 183}
+};
+
+static int clamp_byte(int value) {
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+static int etc1_modifier(int table, int index) {
+    int modifier = etc1_modifiers[table][index & 1];
+    return index & 2 ? -modifier : modifier;
+}
+
+// Texels (x, y) of a half block, flip picks 4x2 halves over 2x4 ones
+static bool in_half(int half, bool flip, int x, int y) {
+    return (flip ? y : x) / 2 == half;
+}
+
+typedef struct {
+    int table;
+    int error;
+    // per texel of the block, only the ones of the half are set
+    int indices[16];
+} HalfFit;
+
+// Best table and indices for the texels of one half around an already quantized base colour
+static HalfFit fit_half(const unsigned char *texels, int half, bool flip, const int base[3]) {
+    // Without clamping the error of modifier m on a texel is e0 + 3 m^2 - 2 m s, with s the summed difference
+    // to the base and e0 the error of the base itself, so most tables need no per channel work
+    int positions[8];
+    int sums[8];
+    int base_errors[8];
+    int count = 0;
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            if (!in_half(half, flip, x, y)) {
+                continue;
+            }
+            const unsigned char *texel = texels + (y * 4 + x) * 3;
+            positions[count] = y * 4 + x;
+            sums[count] = 0;
+            base_errors[count] = 0;
+            for (int c = 0; c < 3; ++c) {
+                int d = texel[c] - base[c];
+                sums[count] += d;
+                base_errors[count] += d * d;
+            }
+            count++;
+        }
+    }
+    int base_min = std::min(base[0], std::min(base[1], base[2]));
+    int base_max = std::max(base[0], std::max(base[1], base[2]));
+
+    HalfFit best;
+    best.error = INT_MAX;
+    for (int table = 0; table < 8; ++table) {
+        HalfFit fit;
+        fit.table = table;
+        fit.error = 0;
+        int large = etc1_modifiers[table][1];
+        bool clamps = base_min - large < 0 || base_max + large > 255;
+        for (int i = 0; i < count && fit.error < best.error; ++i) {
+            const unsigned char *texel = texels + positions[i] * 3;
+            int best_index = 0;
+            int best_error = INT_MAX;
+            for (int index = 0; index < 4; ++index) {
+                int modifier = etc1_modifier(table, index);
+                int error;
+                if (clamps) {
+                    error = 0;
+                    for (int c = 0; c < 3; ++c) {
+                        int d = clamp_byte(base[c] + modifier) - texel[c];
+                        error += d * d;
+                    }
+                } else {
+                    error = base_errors[i] + 3 * modifier * modifier - 2 * modifier * sums[i];
+                }
+                if (error < best_error) {
+                    best_error = error;
+                    best_index = index;
+                }
+            }
+            fit.indices[positions[i]] = best_index;
+            fit.error += best_error;
+        }
+        if (fit.error < best.error) {
+            best = fit;
+        }
+    }
+    return best;
+}
+
+static void half_average(const unsigned char *texels, int half, bool flip, float average[3]) {
+    int sum[3] = {0, 0, 0};
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            if (in_half(half, flip, x, y)) {
+                for (int c = 0; c < 3; ++c) {
+                    sum[c] += texels[(y * 4 + x) * 3 + c];
+                }
+            }
+        }
+    }
+    for (int c = 0; c < 3; ++c) {
+        average[c] = sum[c] / 8.0f;
+    }
+}
+
+static int expand4(int value) {
+    return (value << 4) | value;
+}
+
+static int expand5(int value) {
+    return (value << 3) | (value >> 2);
+}
+
+typedef struct {
+    uint32_t high;
+    int error;
+    HalfFit halves[2];
+} BlockFit;
+
+static void write_block(const BlockFit *fit, bool flip, unsigned char *block) {
+    uint32_t low = 0;
+    for (int half = 0; half < 2; ++half) {
+        for (int y = 0; y < 4; ++y) {
+            for (int x = 0; x < 4; ++x) {
+                if (!in_half(half, flip, x, y)) {
+                    continue;
+                }
+                // texel bits are numbered column by column
+                int bit = x * 4 + y;
+                int index = fit->halves[half].indices[y * 4 + x];
+                low |= (uint32_t) (index >> 1) << (16 + bit);
+                low |= (uint32_t) (index & 1) << bit;
+            }
+        }
+    }
+    uint32_t high = fit->high | (uint32_t) fit->halves[0].table << 5 | (uint32_t) fit->halves[1].table << 2 |
+                    (flip ? 1u : 0u);
+    for (int i = 0; i < 4; ++i) {
+        block[i] = (unsigned char) (high >> (24 - 8 * i));
+        block[4 + i] = (unsigned char) (low >> (24 - 8 * i));
+    }
+}
+
+size_t etc1_image_size(int width, int height) {
+    return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * ETC1_BLOCK_SIZE;
+}
+
+void etc1_encode_block(const unsigned char *texels, unsigned char *block) {
+    BlockFit best = {};
+    best.error = INT_MAX;
+    bool best_flip = false;
+
+    for (int flip = 0; flip < 2; ++flip) {
+        float averages[2][3];
+        half_average(texels, 0, flip != 0, averages[0]);
+        half_average(texels, 1, flip != 0, averages[1]);
+
+        bool delta_clamped = false;
+
+        // differential mode, 5 bits per channel for the first half and a 3 bit signed delta for the second
+        {
+            BlockFit fit;
+            int first[3];
+            int delta[3];
+            int bases[2][3];
+            for (int c = 0; c < 3; ++c) {
+                first[c] = (int) (averages[0][c] * 31.0f / 255.0f + 0.5f);
+                int second = (int) (averages[1][c] * 31.0f / 255.0f + 0.5f);
+                delta[c] = second - first[c];
+                if (delta[c] < -4 || delta[c] > 3) {
+                    // the halves are too far apart, clamped here and individual mode gets tried too
+                    delta[c] = delta[c] < -4 ? -4 : 3;
+                    delta_clamped = true;
+                }
+                bases[0][c] = expand5(first[c]);
+                bases[1][c] = expand5(first[c] + delta[c]);
+            }
+            fit.high = (uint32_t) first[0] << 27 | (uint32_t) (delta[0] & 7) << 24 |
+                       (uint32_t) first[1] << 19 | (uint32_t) (delta[1] & 7) << 16 |
+                       (uint32_t) first[2] << 11 | (uint32_t) (delta[2] & 7) << 8 | 1u << 1;
+            fit.halves[0] = fit_half(texels, 0, flip != 0, bases[0]);
+            fit.halves[1] = fit_half(texels, 1, flip != 0, bases[1]);
+            fit.error = fit.halves[0].error + fit.halves[1].error;
+            if (fit.error < best.error) {
+                best = fit;
+                best_flip = flip != 0;
+            }
+        }
+
+        // individual mode, 4 bits per channel and half. Coarser than differential mode, it only wins when the
+        // halves differ too much for the delta.
+        if (delta_clamped) {
+            BlockFit fit;
+            int quantized[2][3];
+            int bases[2][3];
+            for (int half = 0; half < 2; ++half) {
+                for (int c = 0; c < 3; ++c) {
+                    quantized[half][c] = (int) (averages[half][c] * 15.0f / 255.0f + 0.5f);
+                    bases[half][c] = expand4(quantized[half][c]);
+                }
+            }
+            fit.high = (uint32_t) quantized[0][0] << 28 | (uint32_t) quantized[1][0] << 24 |
+                       (uint32_t) quantized[0][1] << 20 | (uint32_t) quantized[1][1] << 16 |
+                       (uint32_t) quantized[0][2] << 12 | (uint32_t) quantized[1][2] << 8;
+            fit.halves[0] = fit_half(texels, 0, flip != 0, bases[0]);
+            fit.halves[1] = fit_half(texels, 1, flip != 0, bases[1]);
+            fit.error = fit.halves[0].error + fit.halves[1].error;
+            if (fit.error < best.error) {
+                best = fit;
+                best_flip = flip != 0;
+            }
+        }
+    }
+
+    write_block(&best, best_flip, block);
+}
+
+void etc1_decode_block(const unsigned char *block, unsigned char *texels) {
+    uint32_t high = (uint32_t) block[0] << 24 | (uint32_t) block[1] << 16 | (uint32_t) block[2] << 8 | block[3];
+    uint32_t low = (uint32_t) block[4] << 24 | (uint32_t) block[5] << 16 | (uint32_t) block[6] << 8 | block[7];
+    bool flip = (high & 1) != 0;
+    bool differential = (high & 2) != 0;
+    int tables[2] = {(int) (high >> 5) & 7, (int) (high >> 2) & 7};
+
+    int bases[2][3];
+    for (int c = 0; c < 3; ++c) {
+        int shift = 24 - 8 * c;
+        if (differential) {
+            int first = (int) (high >> (shift + 3)) & 31;
+            int delta = (int) (high >> shift) & 7;
+            delta = delta >= 4 ? delta - 8 : delta;
+            bases[0][c] = expand5(first);
+            bases[1][c] = expand5((first + delta) & 31);
+        } else {
+            bases[0][c] = expand4((int) (high >> (shift + 4)) & 15);
+            bases[1][c] = expand4((int) (high >> shift) & 15);
+        }
+    }
+
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            int half = in_half(1, flip, x, y) ? 1 : 0;
+            int bit = x * 4 + y;
+            int index = (int) ((low >> (16 + bit)) & 1) << 1 | (int) ((low >> bit) & 1);
+            int modifier = etc1_modifier(tables[half], index);
+            for (int c = 0; c < 3; ++c) {
+                texels[(y * 4 + x) * 3 + c] = (unsigned char) clamp_byte(bases[half][c] + modifier);
+            }
+        }
+    }
+}
+
+typedef struct {
+    const unsigned char *pixels;
+    int width;
+    int height;
+    int channels;
+    unsigned char *result;
+} EncodeJob;
+
+static void encode_block_row_job(void *user, int block_y) {
+    auto *job = (EncodeJob *) user;
+    int blocks_x = (job->width + 3) / 4;
+    unsigned char texels[16 * 3];
+    for (int block_x = 0; block_x < blocks_x; ++block_x) {
+        for (int y = 0; y < 4; ++y) {
+            for (int x = 0; x < 4; ++x) {
+                // partial blocks repeat the last row / column
+                int px = block_x * 4 + x < job->width ? block_x * 4 + x : job->width - 1;
+                int py = block_y * 4 + y < job->height ? block_y * 4 + y : job->height - 1;
+                memcpy(texels + (y * 4 + x) * 3, job->pixels + ((size_t) py * job->width + px) * job->channels, 3);
+            }
+        }
+        etc1_encode_block(texels, job->result + ((size_t) block_y * blocks_x + block_x) * ETC1_BLOCK_SIZE);
+    }
+}
+
+void etc1_encode_image(const unsigned char *pixels, int width, int height, int channels, unsigned char *result) {
+    EncodeJob job;
+    job.pixels = pixels;
+    job.width = width;
+    job.height = height;
+    job.channels = channels;
+    job.result = result;
+    jobs_parallel_for((height + 3) / 4, encode_block_row_job, &job);
+}
+
+void etc1_decode_image(const unsigned char *data, int width, int height, int channels, unsigned char *pixels) {
+    int blocks_x = (width + 3) / 4;
+    unsigned char texels[16 * 3];
+    for (int block_y = 0; block_y < (height + 3) / 4; ++block_y) {
+        for (int block_x = 0; block_x < blocks_x; ++block_x) {
+            etc1_decode_block(data + ((size_t) block_y * blocks_x + block_x) * ETC1_BLOCK_SIZE, texels);
+            for (int y = 0; y < 4 && block_y * 4 + y < height; ++y) {
+                for (int x = 0; x < 4 && block_x * 4 + x < width; ++x) {
+                    size_t offset = ((size_t) (block_y * 4 + y) * width + block_x * 4 + x) * channels;
+                    memcpy(pixels + offset, texels + (y * 4 + x) * 3, 3);
+                    if (channels == 4) {
+                        pixels[offset + 3] = 255;
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,29 @@
+//
+// ETC1 block compression (GL_OES_compressed_ETC1_RGB8_texture). Each 4x4 block of texels becomes 8 bytes,
+// RGB only. No GL calls, the encoder runs on the loader jobs and in the host tools.
+//
+
+#ifndef BLOCKS_GP_ETC_H
+#define BLOCKS_GP_ETC_H
+
+#include <cstddef>
+
+#define ETC1_BLOCK_SIZE 8
+// GL_ETC1_RGB8_OES
+#define ETC1_RGB8_FORMAT 0x8D64
+
+// Bytes of a width x height ETC1 image, partial blocks at the edges are whole blocks
+size_t etc1_image_size(int width, int height);
+
+// texels are the 16 texels of the block, row by row, 3 bytes each
+void etc1_encode_block(const unsigned char *texels, unsigned char *block);
+
+void etc1_decode_block(const unsigned char *block, unsigned char *texels);
+
+// pixels has 3 or 4 channels, alpha is dropped. The block rows are encoded on the jobs pool.
+void etc1_encode_image(const unsigned char *pixels, int width, int height, int channels, unsigned char *result);
+
+// Decodes into width x height texels of 3 (RGB) or 4 (RGBA, alpha 255) channels
+void etc1_decode_image(const unsigned char *data, int width, int height, int channels, unsigned char *pixels);
+
+#endif //BLOCKS_GP_ETC_H
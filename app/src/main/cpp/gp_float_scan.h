@@ -0,0 +1,258 @@
+//
+// Tokenizer and number parser for whitespace separated text (.smodel files).
+//
+// Delimiters are found 16 bytes at a time with SSE2 on x86 hosts and NEON on device, numbers are
+// parsed without going through the locale aware libc functions and the source buffer is never
+// written to.
+//
+
+#ifndef BLOCKS_GP_FLOAT_SCAN_H
+#define BLOCKS_GP_FLOAT_SCAN_H
+
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_SIMD 1
+// one mask bit per byte
+#define SCAN_BITS_PER_BYTE 1
+#define SCAN_FULL_MASK 0xFFFFull
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SCAN_SIMD 1
+// four mask bits per byte, see scan_delimiter_mask
+#define SCAN_BITS_PER_BYTE 4
+#define SCAN_FULL_MASK 0xFFFFFFFFFFFFFFFFull
+#else
+#define SCAN_SIMD 0
+#endif
+
+#define SCAN_BLOCK 16
+
+// Every byte up to ' ' (space, \n, \r, \t and the terminating \0) separates tokens.
+static inline bool scan_is_delimiter(char c) {
+    return (unsigned char) c <= ' ';
+}
+
+#if SCAN_SIMD
+
+// Mask of the delimiter bytes in the SCAN_BLOCK bytes at p. p[i] maps to bits [i * SCAN_BITS_PER_BYTE, (i + 1) * SCAN_BITS_PER_BYTE).
+static inline uint64_t scan_delimiter_mask(const char *p) {
+#if defined(__SSE2__)
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    __m128i is_delimiter = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(' ')), v);
+    return (uint64_t) (uint32_t) _mm_movemask_epi8(is_delimiter);
+#else
+    uint8x16_t v = vld1q_u8((const uint8_t *) p);
+    uint8x16_t is_delimiter = vcleq_u8(v, vdupq_n_u8(' '));
+    // NEON has no movemask, narrowing by 4 keeps a nibble per byte
+    uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(is_delimiter), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+#endif
+}
+
+#endif
+
+// First byte in [p, end) that is not a delimiter, end if there is none.
+static inline const char *scan_skip_delimiters(const char *p, const char *end) {
+#if SCAN_SIMD
+    while (p + SCAN_BLOCK <= end) {
+        uint64_t mask = ~scan_delimiter_mask(p) & SCAN_FULL_MASK;
+        if (mask) {
+            return p + __builtin_ctzll(mask) / SCAN_BITS_PER_BYTE;
+        }
+        p += SCAN_BLOCK;
+    }
+#endif
+    while (p < end && scan_is_delimiter(*p)) p++;
+    return p;
+}
+
+// First delimiter in [p, end), end if there is none.
+static inline const char *scan_find_delimiter(const char *p, const char *end) {
+#if SCAN_SIMD
+    while (p + SCAN_BLOCK <= end) {
+        uint64_t mask = scan_delimiter_mask(p);
+        if (mask) {
+            return p + __builtin_ctzll(mask) / SCAN_BITS_PER_BYTE;
+        }
+        p += SCAN_BLOCK;
+    }
+#endif
+    while (p < end && !scan_is_delimiter(*p)) p++;
+    return p;
+}
+
+// Number of tokens in [p, end), p is assumed to be at the start of a line.
+static inline long scan_count_tokens(const char *p, const char *end) {
+    long count = 0;
+    bool previous_is_delimiter = true;
+#if SCAN_SIMD
+    const uint64_t byte_bits = (1ull << SCAN_BITS_PER_BYTE) - 1;
+    while (p + SCAN_BLOCK <= end) {
+        uint64_t delimiters = scan_delimiter_mask(p);
+        // a token starts on every non delimiter byte that follows a delimiter
+        uint64_t follows_delimiter = (delimiters << SCAN_BITS_PER_BYTE) | (previous_is_delimiter ? byte_bits : 0);
+        uint64_t starts = ~delimiters & follows_delimiter & SCAN_FULL_MASK;
+        count += __builtin_popcountll(starts) / SCAN_BITS_PER_BYTE;
+        previous_is_delimiter = (delimiters >> ((SCAN_BLOCK - 1) * SCAN_BITS_PER_BYTE)) & 1;
+        p += SCAN_BLOCK;
+    }
+#endif
+    while (p < end) {
+        bool is_delimiter = scan_is_delimiter(*p);
+        if (!is_delimiter && previous_is_delimiter) count++;
+        previous_is_delimiter = is_delimiter;
+        p++;
+    }
+    return count;
+}
+
+// Moves *cursor past the next token. Returns false when there are no tokens left.
+static inline bool scan_next_token(const char **cursor, const char *end, const char **token_begin,
+                                   const char **token_end) {
+    const char *p = scan_skip_delimiters(*cursor, end);
+    if (p >= end) {
+        *cursor = end;
+        return false;
+    }
+    *token_begin = p;
+    *token_end = scan_find_delimiter(p, end);
+    *cursor = *token_end;
+    return true;
+}
+
+static inline bool scan_is_number_start(char c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.';
+}
+
+static inline long scan_parse_int(const char *p, const char *end) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    long value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    return negative ? -value : value;
+}
+
+// Parses [p, end) as a decimal float ([+-]digits[.digits][(e|E)[+-]digits]).
+// Up to 19 significant digits are accumulated exactly, then scaled by an exact power of ten in double
+// precision, which matches strtof for everything the model exporter writes.
+static inline float scan_parse_float(const char *p, const char *end) {
+    static const double powers_of_ten[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const int max_power = 22;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa) digits++;
+        } else {
+            exponent++;
+        }
+        p++;
+    }
+
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa) digits++;
+                exponent--;
+            }
+            p++;
+        }
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        exponent += (int) scan_parse_int(p + 1, end);
+    }
+
+    double value = (double) mantissa;
+    while (exponent > max_power) {
+        value *= powers_of_ten[max_power];
+        exponent -= max_power;
+    }
+    while (exponent < -max_power) {
+        value /= powers_of_ten[max_power];
+        exponent += max_power;
+    }
+    value = exponent < 0 ? value / powers_of_ten[-exponent] : value * powers_of_ten[exponent];
+
+    return (float) (negative ? -value : value);
+}
+
+// Parses consecutive numeric tokens into out. Stops after max_count values, at the end of the buffer or
+// in front of the first token that does not look like a number, leaving *cursor there.
+static inline int scan_parse_floats(const char **cursor, const char *end, float *out, int max_count) {
+    const char *p = *cursor;
+    int count = 0;
+
+#if SCAN_SIMD
+    // One delimiter mask serves every token that starts and ends inside the same block,
+    // only tokens crossing the block edge go through scan_find_delimiter.
+    while (count < max_count && p + SCAN_BLOCK <= end) {
+        uint64_t delimiters = scan_delimiter_mask(p);
+        int offset = 0;
+        while (count < max_count && offset < SCAN_BLOCK) {
+            uint64_t starts = ~delimiters & (SCAN_FULL_MASK << (offset * SCAN_BITS_PER_BYTE)) & SCAN_FULL_MASK;
+            if (!starts) {
+                offset = SCAN_BLOCK;
+                break;
+            }
+            int start = __builtin_ctzll(starts) / SCAN_BITS_PER_BYTE;
+            if (!scan_is_number_start(p[start])) {
+                *cursor = p + start;
+                return count;
+            }
+
+            uint64_t ends = delimiters & (SCAN_FULL_MASK << (start * SCAN_BITS_PER_BYTE));
+            if (!ends) {
+                const char *token_end = scan_find_delimiter(p + start, end);
+                out[count++] = scan_parse_float(p + start, token_end);
+                p = token_end;
+                offset = -1;
+                break;
+            }
+
+            offset = __builtin_ctzll(ends) / SCAN_BITS_PER_BYTE;
+            out[count++] = scan_parse_float(p + start, p + offset);
+        }
+        if (offset >= 0) {
+            p += offset;
+        }
+    }
+#endif
+
+    while (count < max_count) {
+        p = scan_skip_delimiters(p, end);
+        if (p >= end || !scan_is_number_start(*p)) {
+            break;
+        }
+        const char *token_end = scan_find_delimiter(p, end);
+        out[count++] = scan_parse_float(p, token_end);
+        p = token_end;
+    }
+    *cursor = p;
+    return count;
+}
+
+#endif //BLOCKS_GP_FLOAT_SCAN_H
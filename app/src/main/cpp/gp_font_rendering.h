@@ -20,12 +20,18 @@ typedef struct {
     int font_first_char;
 } FontData;
 
-FontData font_init() {
-    FontData result;
-    result.texture = 0;
-    result.vertex_data = NULL;
-    result.vertex_data_size = 0;
-    result.max_text_length = 0;
+// CPU side of the font, baked glyph bitmap and metrics. Safe to build off the GL thread.
+typedef struct {
+    uint8_t *bitmap;
+    int bitmap_width;
+    int bitmap_height;
+    int first_char;
+    stbtt_bakedchar *char_data;
+} FontBake;
+
+FontBake font_bake() {
+    FontBake bake;
+    memset(&bake, 0, sizeof(bake));
 
     // Prepare font
     auto *font_file = reinterpret_cast<unsigned char *>(read_entire_file("cmunrm.ttf",
@@ -35,7 +41,7 @@ FontData font_init() {
     if (!stbtt_InitFont(&info, font_file, 0)) {
         log_str("init font failed");
         assert(0);
-        return result;
+        return bake;
     } else {
         log_str("font loaded");
     }
@@ -55,21 +61,38 @@ FontData font_init() {
 
     stbtt_BakeFontBitmap(font_file,0, font_size, bitmap, bitmap_width, bitmap_height, font_first_char, font_char_count, font_char_data);
 
-    GLuint font_texture = prepare_texture(bitmap, bitmap_width, bitmap_height, 1);
-
     // Cleanup
-    free(bitmap);
     free(font_file);
 
+    bake.bitmap = bitmap;
+    bake.bitmap_width = bitmap_width;
+    bake.bitmap_height = bitmap_height;
+    bake.first_char = font_first_char;
+    bake.char_data = font_char_data;
+    return bake;
+}
+
+// GL side, creates the texture and takes ownership of the baked glyph data.
+FontData font_upload(FontBake *bake) {
+    FontData result;
+    result.texture = 0;
+    result.vertex_data = NULL;
+    result.vertex_data_size = 0;
+    result.max_text_length = 0;
+
+    GLuint font_texture = prepare_texture(bake->bitmap, bake->bitmap_width, bake->bitmap_height, 1);
+    free(bake->bitmap);
+    bake->bitmap = NULL;
+
     {
         result.texture = font_texture;
         result.max_text_length = 10;
         result.vertex_data_size = sizeof(float) * result.max_text_length * 6 * 5;
 
-        result.font_char_data = font_char_data;
-        result.font_bitmap_width = bitmap_width;
-        result.font_bitmap_height = bitmap_height;
-        result.font_first_char = font_first_char;
+        result.font_char_data = bake->char_data;
+        result.font_bitmap_width = bake->bitmap_width;
+        result.font_bitmap_height = bake->bitmap_height;
+        result.font_first_char = bake->first_char;
 
         result.vertex_data = (float *) malloc(result.vertex_data_size);
         memset(result.vertex_data, 0, result.vertex_data_size);
@@ -77,7 +100,16 @@ FontData font_init() {
     return result;
 }
 
-void font_render(FontData d, float initial_x, float initial_y, const char *text, int shader, float model_matrix[], float view_matrix[], float projection_matrix[]) {
+FontData font_init() {
+    FontBake bake = font_bake();
+    return font_upload(&bake);
+}
+
+void font_render(FontData d, float initial_x, float initial_y, const char *text, ShaderProgram *shader, float model_matrix[], float view_matrix[], float projection_matrix[]) {
+    if (!d.font_char_data) {
+        // not loaded yet
+        return;
+    }
     memset(d.vertex_data, 0, d.vertex_data_size);
     int len = M_MIN(d.max_text_length, strlen(text));
     //log_fmt("rendering %d characters", len);
@@ -102,46 +134,27 @@ void font_render(FontData d, float initial_x, float initial_y, const char *text,
 
     // Render
     {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, d.texture);
-        GL_ERR;
-
-        GLint position = glGetAttribLocation(shader,
-                                             "vertex_position");
-        GLint uvs = glGetAttribLocation(shader, "vertex_uvs");
-
-        GL_ERR;
-        GLint texture_unit = glGetAttribLocation(shader,
-                                                 "texture_unit");
-        GL_ERR;
-        glUniform1f(texture_unit, 0.0);
-        GL_ERR;
-        glUniformMatrix4fv(
-                glGetUniformLocation(shader, "model_matrix"),
-                1,
-                GL_FALSE,
-                model_matrix);
-        GL_ERR;
-        glUniformMatrix4fv(
-                glGetUniformLocation(shader, "view_matrix"),
-                1,
-                GL_FALSE,
-                view_matrix);
+        gl_state_active_texture(0);
+        gl_state_bind_texture(d.texture);
         GL_ERR;
-        glUniformMatrix4fv(
-                glGetUniformLocation(shader, "projection_matrix"),
-                1,
-                GL_FALSE, projection_matrix);
 
+        GLint position = shader->attributes[SHADER_ATTRIBUTE_POSITION];
+        GLint uvs = shader->attributes[SHADER_ATTRIBUTE_UVS];
+        shader_set_int(shader, SHADER_UNIFORM_TEXTURE_UNIT, 0);
+        shader_set_mat4(shader, SHADER_UNIFORM_MODEL_MATRIX, model_matrix);
+        shader_set_mat4(shader, SHADER_UNIFORM_VIEW_MATRIX, view_matrix);
+        shader_set_mat4(shader, SHADER_UNIFORM_PROJECTION_MATRIX, projection_matrix);
         GL_ERR;
 
-        // Render text in quads
+        // Render text in quads, from client side arrays
+        gl_state_bind_vertex_array(0);
+        gl_state_bind_buffer(GL_ARRAY_BUFFER, 0);
         int bytes_per_float = 4;
         int stride = bytes_per_float * 5;
-        glEnableVertexAttribArray(position);
+        gl_state_vertex_attrib_array(position, true);
         glVertexAttribPointer(position, 3, GL_FLOAT, GL_FALSE, stride, d.vertex_data);
         GL_ERR;
-        glEnableVertexAttribArray(uvs);
+        gl_state_vertex_attrib_array(uvs, true);
         glVertexAttribPointer(uvs, 2, GL_FLOAT, GL_FALSE, stride, d.vertex_data + 3);
         //glDrawArrays(GL_TRIANGLES, 0, len * 6);
         glDrawArrays(GL_TRIANGLES, 0, strlen(text) * 6);
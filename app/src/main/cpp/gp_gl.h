@@ -6,6 +6,10 @@
 #define BLOCKS_GP_GL_H
 
 #include <cassert>
+#include <cstring>
+
+#include "gp_image.h"
+#include "gp_gl_state.h"
 
 #define SHADER_LOGGING_ON true
 
@@ -14,6 +18,23 @@ static void print_gl_string(const char *name, GLenum s) {
     log_fmt("GL %s = %s\n", name, v);
 }
 
+// Extensions are space separated, a plain strstr would also match prefixes of longer names
+bool gl_has_extension(const char *name) {
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+    if (!extensions) {
+        return false;
+    }
+    size_t length = strlen(name);
+    for (const char *found = strstr(extensions, name); found; found = strstr(found + length, name)) {
+        bool starts = found == extensions || found[-1] == ' ';
+        bool ends = found[length] == ' ' || found[length] == '\0';
+        if (starts && ends) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void gl_error(const char *file, int line) {
     bool has_errors = false;
     for (GLint error = glGetError(); error; error = glGetError()) {
@@ -128,25 +149,153 @@ GLuint create_program(const char *pVertexSource, const char *pFragmentSource) {
     return program_obj_id;
 }
 
-GLuint prepare_texture(unsigned char *pixels, int width, int height, int channels) {
-    GLuint texture = 0;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+// GL ES 2 has no sampler objects, the sampling state is part of each texture and set with its image
+typedef struct {
+    GLint min_filter;
+    GLint mag_filter;
+    GLint wrap;
+} TextureSampler;
+
+// Glyphs and other textures drawn about 1:1
+static const TextureSampler sampler_bilinear_nearest = {GL_LINEAR, GL_NEAREST, GL_REPEAT};
+static const TextureSampler sampler_bilinear = {GL_LINEAR, GL_LINEAR, GL_REPEAT};
+// Model textures, needs the mip levels
+static const TextureSampler sampler_trilinear = {GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT};
+// Atlases (see gp_atlas.h), entries must not repeat into each other
+static const TextureSampler sampler_atlas = {GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE};
+
+// An ES 3 context, from the version string ("OpenGL ES 3.x ...")
+bool gl_is_es3() {
+    const char *version = (const char *) glGetString(GL_VERSION);
+    return version && strncmp(version, "OpenGL ES 3", 11) == 0;
+}
 
+// GL_OES_texture_npot lifts the ES 2 limits on non power of two textures (no mip levels, clamp to edge only),
+// ES 3 has none of them and many of its drivers do not list the extension. Render thread only.
+bool gl_has_npot_textures() {
+    static int has = -1;
+    if (has < 0) {
+        has = gl_is_es3() || gl_has_extension("GL_OES_texture_npot");
+    }
+    return has != 0;
+}
+
+GLenum gl_pixel_format(int channels) {
     if (channels == 3) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+        return GL_RGB;
     } else if (channels == 4) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
-                     pixels);
-    } else {
-        // note: GL_ALPHA is the alternative to GL_RED. Do not forget to read the texture2D().a value in the fragment shader or it won't display.
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, width, height, 0, GL_ALPHA, GL_UNSIGNED_BYTE,
-                     pixels);
+        return GL_RGBA;
+    }
+    // note: GL_ALPHA is the alternative to GL_RED. Do not forget to read the texture2D().a value in the fragment shader or it won't display.
+    return GL_ALPHA;
+}
+
+// Bytes of a texel of an uncompressed format
+int gl_texel_size(GLenum format, GLenum type) {
+    if (type == GL_UNSIGNED_SHORT_5_6_5 || type == GL_UNSIGNED_SHORT_4_4_4_4 || type == GL_UNSIGNED_SHORT_5_5_5_1) {
+        return 2;
     }
+    switch (format) {
+        case GL_RGBA:
+            return 4;
+        case GL_RGB:
+            return 3;
+        case GL_LUMINANCE_ALPHA:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+// Sets sampler on the bound texture, falling back to what the texture supports so it never ends up incomplete
+void apply_texture_sampler(TextureSampler sampler, int width, int height, bool has_mips) {
+    GLint min_filter = sampler.min_filter;
+    if (!has_mips && min_filter != GL_NEAREST && min_filter != GL_LINEAR) {
+        min_filter = min_filter == GL_NEAREST_MIPMAP_NEAREST ? GL_NEAREST : GL_LINEAR;
+    }
+    GLint wrap = sampler.wrap;
+    if (!image_is_power_of_two(width, height) && !gl_has_npot_textures()) {
+        wrap = GL_CLAMP_TO_EDGE;
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.mag_filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+}
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+// Replaces the image of an existing texture, the texture name (and everything holding it) stays valid.
+// mips can be null, the texture then only has level 0. The texture is left bound to the active unit.
+void upload_texture_levels(GLuint texture, unsigned char *pixels, int width, int height, int channels,
+                           const ImageMips *mips, TextureSampler sampler) {
+    gl_state_bind_texture(texture);
+    bool has_mips = mips && mips->level_count > 1;
+    apply_texture_sampler(sampler, width, height, has_mips);
+
+    GLenum format = gl_pixel_format(channels);
+    if (channels != 4) {
+        // rows of 1 and 3 channel images are not 4 byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    }
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+    if (has_mips) {
+        for (int i = 1; i < mips->level_count; ++i) {
+            const ImageLevel *level = &mips->levels[i];
+            glTexImage2D(GL_TEXTURE_2D, i, format, level->width, level->height, 0, format, GL_UNSIGNED_BYTE,
+                         level->pixels);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// Same as upload_texture_levels for levels already in format. type 0 means a block compressed format
+// (glCompressedTexImage2D), like glType in KTX files. levels[0] is the full size image.
+void upload_texture_data(GLuint texture, GLenum format, GLenum type, const TextureLevel *levels, int level_count,
+                         TextureSampler sampler) {
+    gl_state_bind_texture(texture);
+    if (level_count > 1 && !image_is_power_of_two(levels[0].width, levels[0].height) && !gl_has_npot_textures()) {
+        // non power of two textures can not have mip levels in plain ES 2
+        level_count = 1;
+    }
+    apply_texture_sampler(sampler, levels[0].width, levels[0].height, level_count > 1);
+    for (int i = 0; i < level_count; ++i) {
+        const TextureLevel *level = &levels[i];
+        if (type == 0) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, format, level->width, level->height, 0, (GLsizei) level->size,
+                                   level->data);
+        } else {
+            // tightly packed rows are told apart from 4 byte aligned ones by the size
+            size_t packed_size = (size_t) level->width * level->height * gl_texel_size(format, type);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, level->size == packed_size ? 1 : 4);
+            glTexImage2D(GL_TEXTURE_2D, i, format, level->width, level->height, 0, format, type, level->data);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void upload_texture(GLuint texture, unsigned char *pixels, int width, int height, int channels) {
+    upload_texture_levels(texture, pixels, width, height, channels, nullptr, sampler_bilinear_nearest);
+}
+
+GLuint prepare_texture(unsigned char *pixels, int width, int height, int channels) {
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    upload_texture(texture, pixels, width, height, channels);
+    return texture;
+}
+
+// 2x2 grey checker shown until the real image is uploaded into the same texture name
+void upload_placeholder_texture(GLuint texture) {
+    unsigned char pixels[] = {
+            96, 96, 96, 255, 160, 160, 160, 255,
+            160, 160, 160, 255, 96, 96, 96, 255
+    };
+    upload_texture(texture, pixels, 2, 2, 4);
+}
+
+GLuint prepare_placeholder_texture() {
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    upload_placeholder_texture(texture);
     return texture;
 }
 
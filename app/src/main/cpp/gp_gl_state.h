@@ -0,0 +1,343 @@
+//
+// Shadow of the GL state the renderers change on every draw: program, texture, buffer and vertex array bindings,
+// capabilities, depth and blend state and the enabled vertex attribute arrays and their divisors. Each gl_state_*
+// call only reaches GL when the value differs from the one GL already has, the calls issued and filtered are
+// counted per frame.
+//
+// gl_state_invalidate forgets what GL had, before the first use and whenever GL was changed around the cache
+// (a new context). Render thread only.
+//
+
+#ifndef BLOCKS_GP_GL_STATE_H
+#define BLOCKS_GP_GL_STATE_H
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <EGL/egl.h>
+
+#define GL_STATE_TEXTURE_UNITS 8
+#define GL_STATE_VERTEX_ATTRIBUTES 16
+// Never a GL name or enum the renderers use
+#define GL_STATE_UNKNOWN 0xFFFFFFFFu
+
+typedef enum {
+    GL_STATE_USE_PROGRAM,
+    GL_STATE_ACTIVE_TEXTURE,
+    GL_STATE_BIND_TEXTURE,
+    GL_STATE_BIND_BUFFER,
+    GL_STATE_BIND_VERTEX_ARRAY,
+    GL_STATE_CAPABILITY,
+    GL_STATE_DEPTH_MASK,
+    GL_STATE_DEPTH_FUNC,
+    GL_STATE_BLEND_FUNC,
+    GL_STATE_VERTEX_ATTRIB_ARRAY,
+    GL_STATE_VERTEX_ATTRIB_DIVISOR,
+    GL_STATE_CALL_COUNT
+} GlStateCall;
+
+static const char *gl_state_call_names[GL_STATE_CALL_COUNT] = {
+        "program", "active texture", "bind texture", "bind buffer", "bind vertex array", "enable", "depth mask",
+        "depth func", "blend func", "attrib array", "attrib divisor"};
+
+// The capabilities tracked by gl_state_enable, others go straight to GL
+typedef enum {
+    GL_STATE_DEPTH_TEST,
+    GL_STATE_BLEND,
+    GL_STATE_CULL_FACE,
+    GL_STATE_CAPABILITY_COUNT
+} GlStateCapability;
+
+typedef struct {
+    int issued[GL_STATE_CALL_COUNT];
+    int filtered[GL_STATE_CALL_COUNT];
+} GlStateStats;
+
+typedef struct {
+    GLuint program;
+    // unit index, not GL_TEXTURE0 + unit
+    GLuint active_unit;
+    GLuint textures[GL_STATE_TEXTURE_UNITS];
+    GLuint array_buffer;
+    // part of the vertex array object state, like the attribute arrays
+    GLuint element_buffer;
+    GLuint vertex_array;
+    // -1 unknown, 0 or 1
+    int8_t capabilities[GL_STATE_CAPABILITY_COUNT];
+    int8_t depth_mask;
+    GLenum depth_func;
+    GLenum blend_source;
+    GLenum blend_destination;
+    // bit per attribute location, only the known_attributes bits of enabled_attributes mean anything
+    uint32_t enabled_attributes;
+    uint32_t known_attributes;
+    // bit per attribute location with divisor 1, only the known_divisors bits mean anything
+    uint32_t instanced_attributes;
+    uint32_t known_divisors;
+    // the frame being drawn and the last finished one
+    GlStateStats frame;
+    GlStateStats last_frame;
+} GlState;
+
+GlState gl_state;
+
+// GL_OES_vertex_array_object, or the same entry points in core ES 3. The ES 2 headers only declare their pointer
+// types, gl_state_load_vertex_arrays resolves them. Null without either.
+PFNGLGENVERTEXARRAYSOESPROC gl_gen_vertex_arrays = nullptr;
+PFNGLBINDVERTEXARRAYOESPROC gl_bind_vertex_array = nullptr;
+PFNGLDELETEVERTEXARRAYSOESPROC gl_delete_vertex_arrays = nullptr;
+
+// es3 picks the core names, the OES ones otherwise. False when the driver does not have them all.
+bool gl_state_load_vertex_arrays(bool es3) {
+    const char *suffix = es3 ? "" : "OES";
+    char name[32];
+    snprintf(name, sizeof(name), "glGenVertexArrays%s", suffix);
+    gl_gen_vertex_arrays = (PFNGLGENVERTEXARRAYSOESPROC) eglGetProcAddress(name);
+    snprintf(name, sizeof(name), "glBindVertexArray%s", suffix);
+    gl_bind_vertex_array = (PFNGLBINDVERTEXARRAYOESPROC) eglGetProcAddress(name);
+    snprintf(name, sizeof(name), "glDeleteVertexArrays%s", suffix);
+    gl_delete_vertex_arrays = (PFNGLDELETEVERTEXARRAYSOESPROC) eglGetProcAddress(name);
+    if (!gl_gen_vertex_arrays || !gl_bind_vertex_array || !gl_delete_vertex_arrays) {
+        gl_gen_vertex_arrays = nullptr;
+        gl_bind_vertex_array = nullptr;
+        gl_delete_vertex_arrays = nullptr;
+        return false;
+    }
+    return true;
+}
+
+// glDrawArraysInstanced, glDrawElementsInstanced and glVertexAttribDivisor of core ES 3, GL_EXT_instanced_arrays or
+// GL_ANGLE_instanced_arrays, resolved by gl_state_load_instanced_arrays. Null without any of them.
+PFNGLDRAWARRAYSINSTANCEDEXTPROC gl_draw_arrays_instanced = nullptr;
+PFNGLDRAWELEMENTSINSTANCEDEXTPROC gl_draw_elements_instanced = nullptr;
+PFNGLVERTEXATTRIBDIVISOREXTPROC gl_vertex_attrib_divisor = nullptr;
+
+// suffix is "" for the core ES 3 names, "EXT" or "ANGLE" for the extensions. False when the driver does not have
+// them all.
+bool gl_state_load_instanced_arrays(const char *suffix) {
+    char name[40];
+    snprintf(name, sizeof(name), "glDrawArraysInstanced%s", suffix);
+    gl_draw_arrays_instanced = (PFNGLDRAWARRAYSINSTANCEDEXTPROC) eglGetProcAddress(name);
+    snprintf(name, sizeof(name), "glDrawElementsInstanced%s", suffix);
+    gl_draw_elements_instanced = (PFNGLDRAWELEMENTSINSTANCEDEXTPROC) eglGetProcAddress(name);
+    snprintf(name, sizeof(name), "glVertexAttribDivisor%s", suffix);
+    gl_vertex_attrib_divisor = (PFNGLVERTEXATTRIBDIVISOREXTPROC) eglGetProcAddress(name);
+    if (!gl_draw_arrays_instanced || !gl_draw_elements_instanced || !gl_vertex_attrib_divisor) {
+        gl_draw_arrays_instanced = nullptr;
+        gl_draw_elements_instanced = nullptr;
+        gl_vertex_attrib_divisor = nullptr;
+        return false;
+    }
+    return true;
+}
+
+// Keeps the stats
+void gl_state_invalidate() {
+    gl_state.program = GL_STATE_UNKNOWN;
+    gl_state.active_unit = GL_STATE_UNKNOWN;
+    for (int i = 0; i < GL_STATE_TEXTURE_UNITS; ++i) {
+        gl_state.textures[i] = GL_STATE_UNKNOWN;
+    }
+    gl_state.array_buffer = GL_STATE_UNKNOWN;
+    gl_state.element_buffer = GL_STATE_UNKNOWN;
+    gl_state.vertex_array = GL_STATE_UNKNOWN;
+    memset(gl_state.capabilities, -1, sizeof(gl_state.capabilities));
+    gl_state.depth_mask = -1;
+    gl_state.depth_func = GL_STATE_UNKNOWN;
+    gl_state.blend_source = GL_STATE_UNKNOWN;
+    gl_state.blend_destination = GL_STATE_UNKNOWN;
+    gl_state.enabled_attributes = 0;
+    gl_state.known_attributes = 0;
+    gl_state.instanced_attributes = 0;
+    gl_state.known_divisors = 0;
+}
+
+// True when call has to reach GL
+bool gl_state_changed(GlStateCall call, bool changed) {
+    if (changed) {
+        gl_state.frame.issued[call]++;
+    } else {
+        gl_state.frame.filtered[call]++;
+    }
+    return changed;
+}
+
+void gl_state_use_program(GLuint program) {
+    if (gl_state_changed(GL_STATE_USE_PROGRAM, gl_state.program != program)) {
+        glUseProgram(program);
+        gl_state.program = program;
+    }
+}
+
+void gl_state_active_texture(int unit) {
+    assert(unit < GL_STATE_TEXTURE_UNITS);
+    if (gl_state_changed(GL_STATE_ACTIVE_TEXTURE, gl_state.active_unit != (GLuint) unit)) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        gl_state.active_unit = unit;
+    }
+}
+
+// GL_TEXTURE_2D on the active unit
+void gl_state_bind_texture(GLuint texture) {
+    if (gl_state.active_unit == GL_STATE_UNKNOWN) {
+        gl_state_active_texture(0);
+    }
+    GLuint *bound = &gl_state.textures[gl_state.active_unit];
+    if (gl_state_changed(GL_STATE_BIND_TEXTURE, *bound != texture)) {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        *bound = texture;
+    }
+}
+
+// GL unbinds a deleted texture from every unit
+void gl_state_delete_texture(GLuint texture) {
+    glDeleteTextures(1, &texture);
+    for (int i = 0; i < GL_STATE_TEXTURE_UNITS; ++i) {
+        if (gl_state.textures[i] == texture) {
+            gl_state.textures[i] = 0;
+        }
+    }
+}
+
+// GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER
+void gl_state_bind_buffer(GLenum target, GLuint buffer) {
+    GLuint *bound = target == GL_ARRAY_BUFFER ? &gl_state.array_buffer : &gl_state.element_buffer;
+    if (gl_state_changed(GL_STATE_BIND_BUFFER, *bound != buffer)) {
+        glBindBuffer(target, buffer);
+        *bound = buffer;
+    }
+}
+
+// 0 is the default vertex array, the only one without vertex array object support. The attribute arrays, their
+// divisors and the element buffer of the new one are unknown.
+void gl_state_bind_vertex_array(GLuint vertex_array) {
+    if (!gl_bind_vertex_array) {
+        assert(vertex_array == 0);
+        return;
+    }
+    if (gl_state_changed(GL_STATE_BIND_VERTEX_ARRAY, gl_state.vertex_array != vertex_array)) {
+        gl_bind_vertex_array(vertex_array);
+        gl_state.vertex_array = vertex_array;
+        gl_state.element_buffer = GL_STATE_UNKNOWN;
+        gl_state.enabled_attributes = 0;
+        gl_state.known_attributes = 0;
+        gl_state.instanced_attributes = 0;
+        gl_state.known_divisors = 0;
+    }
+}
+
+int gl_state_capability(GLenum capability) {
+    switch (capability) {
+        case GL_DEPTH_TEST:
+            return GL_STATE_DEPTH_TEST;
+        case GL_BLEND:
+            return GL_STATE_BLEND;
+        case GL_CULL_FACE:
+            return GL_STATE_CULL_FACE;
+        default:
+            return -1;
+    }
+}
+
+// glEnable / glDisable
+void gl_state_enable(GLenum capability, bool enabled) {
+    int index = gl_state_capability(capability);
+    if (index < 0 || gl_state_changed(GL_STATE_CAPABILITY, gl_state.capabilities[index] != (int8_t) enabled)) {
+        if (enabled) {
+            glEnable(capability);
+        } else {
+            glDisable(capability);
+        }
+        if (index >= 0) {
+            gl_state.capabilities[index] = (int8_t) enabled;
+        }
+    }
+}
+
+void gl_state_depth_mask(bool write) {
+    if (gl_state_changed(GL_STATE_DEPTH_MASK, gl_state.depth_mask != (int8_t) write)) {
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+        gl_state.depth_mask = (int8_t) write;
+    }
+}
+
+void gl_state_depth_func(GLenum func) {
+    if (gl_state_changed(GL_STATE_DEPTH_FUNC, gl_state.depth_func != func)) {
+        glDepthFunc(func);
+        gl_state.depth_func = func;
+    }
+}
+
+void gl_state_blend_func(GLenum source, GLenum destination) {
+    if (gl_state_changed(GL_STATE_BLEND_FUNC,
+                         gl_state.blend_source != source || gl_state.blend_destination != destination)) {
+        glBlendFunc(source, destination);
+        gl_state.blend_source = source;
+        gl_state.blend_destination = destination;
+    }
+}
+
+// glEnableVertexAttribArray / glDisableVertexAttribArray
+void gl_state_vertex_attrib_array(GLint location, bool enabled) {
+    assert(location >= 0 && location < GL_STATE_VERTEX_ATTRIBUTES);
+    uint32_t bit = 1u << location;
+    bool known = (gl_state.known_attributes & bit) != 0;
+    bool was_enabled = (gl_state.enabled_attributes & bit) != 0;
+    if (gl_state_changed(GL_STATE_VERTEX_ATTRIB_ARRAY, !known || was_enabled != enabled)) {
+        if (enabled) {
+            glEnableVertexAttribArray(location);
+            gl_state.enabled_attributes |= bit;
+        } else {
+            glDisableVertexAttribArray(location);
+            gl_state.enabled_attributes &= ~bit;
+        }
+        gl_state.known_attributes |= bit;
+    }
+}
+
+// glVertexAttribDivisor with 1 when instanced, 0 otherwise. Needs gl_state_load_instanced_arrays.
+void gl_state_vertex_attrib_divisor(GLint location, bool instanced) {
+    assert(location >= 0 && location < GL_STATE_VERTEX_ATTRIBUTES);
+    assert(gl_vertex_attrib_divisor);
+    uint32_t bit = 1u << location;
+    bool known = (gl_state.known_divisors & bit) != 0;
+    bool was_instanced = (gl_state.instanced_attributes & bit) != 0;
+    if (gl_state_changed(GL_STATE_VERTEX_ATTRIB_DIVISOR, !known || was_instanced != instanced)) {
+        gl_vertex_attrib_divisor(location, instanced ? 1 : 0);
+        if (instanced) {
+            gl_state.instanced_attributes |= bit;
+        } else {
+            gl_state.instanced_attributes &= ~bit;
+        }
+        gl_state.known_divisors |= bit;
+    }
+}
+
+// After the draws of a frame, gl_state_frame_stats then reports it
+void gl_state_end_frame() {
+    gl_state.last_frame = gl_state.frame;
+    memset(&gl_state.frame, 0, sizeof(GlStateStats));
+}
+
+// Calls of the last finished frame
+const GlStateStats *gl_state_frame_stats() {
+    return &gl_state.last_frame;
+}
+
+void gl_state_log_stats(const GlStateStats *stats) {
+    char line[512];
+    int length = 0;
+    int issued = 0;
+    int filtered = 0;
+    for (int i = 0; i < GL_STATE_CALL_COUNT; ++i) {
+        issued += stats->issued[i];
+        filtered += stats->filtered[i];
+        length += snprintf(line + length, sizeof(line) - length, ", %s %d/%d", gl_state_call_names[i],
+                           stats->issued[i], stats->issued[i] + stats->filtered[i]);
+    }
+    log_fmt("gl state: %d calls issued, %d filtered%s", issued, filtered, line);
+}
+
+#endif //BLOCKS_GP_GL_STATE_H
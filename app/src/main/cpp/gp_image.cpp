@@ -0,0 +1,132 @@
+//
+// Mip chain generation, see gp_image.h
+//
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "gp_image.h"
+
+// Linear -> sRGB goes through a table indexed by the linear value in 1 / LINEAR_TO_SRGB_STEPS steps, fine
+// enough that the steep start of the curve rounds to the right byte
+#define LINEAR_TO_SRGB_STEPS 4095
+
+typedef struct SrgbTables {
+    float to_linear[256];
+    unsigned char to_srgb[LINEAR_TO_SRGB_STEPS + 1];
+
+    SrgbTables() {
+        for (int i = 0; i < 256; ++i) {
+            float c = i / 255.0f;
+            to_linear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i <= LINEAR_TO_SRGB_STEPS; ++i) {
+            float l = i / (float) LINEAR_TO_SRGB_STEPS;
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+            to_srgb[i] = (unsigned char) (c * 255.0f + 0.5f);
+        }
+    }
+} SrgbTables;
+
+static const SrgbTables *srgb_tables() {
+    // built once, on whichever loader job gets here first
+    static SrgbTables tables;
+    return &tables;
+}
+
+bool image_is_power_of_two(int width, int height) {
+    return width > 0 && height > 0 && (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+}
+
+bool image_is_opaque(const unsigned char *pixels, int width, int height, int channels) {
+    if (channels != 2 && channels != 4) {
+        return true;
+    }
+    size_t count = (size_t) width * height;
+    for (size_t i = 0; i < count; ++i) {
+        if (pixels[i * channels + channels - 1] != 255) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int image_level_count(int width, int height) {
+    int count = 1;
+    while (width > 1 || height > 1) {
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+        count++;
+    }
+    return count;
+}
+
+void image_downsample(const unsigned char *pixels, int width, int height, int channels, bool srgb,
+                      unsigned char *result) {
+    int result_width = width > 1 ? width / 2 : 1;
+    int result_height = height > 1 ? height / 2 : 1;
+    int colour_channels = srgb && channels >= 3 ? 3 : 0;
+    const SrgbTables *tables = colour_channels ? srgb_tables() : nullptr;
+    size_t row_size = (size_t) width * channels;
+
+    for (int y = 0; y < result_height; ++y) {
+        // odd sizes drop the last row / column, single texel dimensions reuse it
+        const unsigned char *row0 = pixels + (size_t) (2 * y) * row_size;
+        const unsigned char *row1 = height > 1 ? row0 + row_size : row0;
+        unsigned char *out = result + (size_t) y * result_width * channels;
+        int step = width > 1 ? channels : 0;
+
+        for (int x = 0; x < result_width; ++x) {
+            const unsigned char *a = row0 + (size_t) (2 * x) * channels;
+            const unsigned char *b = row1 + (size_t) (2 * x) * channels;
+            int c = 0;
+            for (; c < colour_channels; ++c) {
+                float sum = tables->to_linear[a[c]] + tables->to_linear[a[c + step]] +
+                            tables->to_linear[b[c]] + tables->to_linear[b[c + step]];
+                out[c] = tables->to_srgb[(int) (sum * (0.25f * LINEAR_TO_SRGB_STEPS) + 0.5f)];
+            }
+            for (; c < channels; ++c) {
+                out[c] = (unsigned char) ((a[c] + a[c + step] + b[c] + b[c + step] + 2) >> 2);
+            }
+            out += channels;
+        }
+    }
+}
+
+void image_build_mips(unsigned char *pixels, int width, int height, int channels, bool srgb, ImageMips *mips) {
+    memset(mips, 0, sizeof(ImageMips));
+    mips->channels = channels;
+    mips->level_count = image_level_count(width, height);
+    assert(mips->level_count <= IMAGE_MAX_LEVELS);
+
+    size_t offsets[IMAGE_MAX_LEVELS];
+    int level_width = width;
+    int level_height = height;
+    for (int i = 0; i < mips->level_count; ++i) {
+        mips->levels[i].width = level_width;
+        mips->levels[i].height = level_height;
+        if (i > 0) {
+            offsets[i] = mips->block_size;
+            mips->block_size += (size_t) level_width * level_height * channels;
+        }
+        level_width = level_width > 1 ? level_width / 2 : 1;
+        level_height = level_height > 1 ? level_height / 2 : 1;
+    }
+
+    mips->levels[0].pixels = pixels;
+    if (mips->block_size) {
+        mips->block = (unsigned char *) malloc(mips->block_size);
+    }
+    for (int i = 1; i < mips->level_count; ++i) {
+        ImageLevel *source = &mips->levels[i - 1];
+        mips->levels[i].pixels = mips->block + offsets[i];
+        image_downsample(source->pixels, source->width, source->height, channels, srgb, mips->levels[i].pixels);
+    }
+}
+
+void image_free_mips(ImageMips *mips) {
+    free(mips->block);
+    memset(mips, 0, sizeof(ImageMips));
+}
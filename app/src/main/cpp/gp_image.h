@@ -0,0 +1,57 @@
+//
+// CPU side image processing for textures: mip chain generation. No GL calls, safe on the loader jobs.
+//
+
+#ifndef BLOCKS_GP_IMAGE_H
+#define BLOCKS_GP_IMAGE_H
+
+#include <cstddef>
+
+// Enough for a 32768 x 32768 level 0
+#define IMAGE_MAX_LEVELS 16
+
+typedef struct {
+    int width;
+    int height;
+    unsigned char *pixels;
+} ImageLevel;
+
+// A level already in the format GL takes, block compressed (see gp_etc.h) or raw texels with tightly packed or
+// 4 byte aligned rows
+typedef struct {
+    int width;
+    int height;
+    const unsigned char *data;
+    size_t size;
+} TextureLevel;
+
+// A full mip chain. levels[0] is the caller's image and stays owned by the caller, levels 1 and up live in
+// one block owned by the chain.
+typedef struct {
+    int channels;
+    int level_count;
+    ImageLevel levels[IMAGE_MAX_LEVELS];
+    unsigned char *block;
+    size_t block_size;
+} ImageMips;
+
+bool image_is_power_of_two(int width, int height);
+
+// True without an alpha channel or when every alpha value is 255
+bool image_is_opaque(const unsigned char *pixels, int width, int height, int channels);
+
+// Levels down to 1 x 1, level 0 included
+int image_level_count(int width, int height);
+
+// 2x2 box filter into a max(1, width / 2) x max(1, height / 2) image. With srgb the colour channels (the
+// first three of 3 and 4 channel images) are averaged in linear space, alpha and 1 / 2 channel images
+// are always averaged as they are.
+void image_downsample(const unsigned char *pixels, int width, int height, int channels, bool srgb,
+                      unsigned char *result);
+
+// Builds levels 1 and up from pixels, each one from the previous level
+void image_build_mips(unsigned char *pixels, int width, int height, int channels, bool srgb, ImageMips *mips);
+
+void image_free_mips(ImageMips *mips);
+
+#endif //BLOCKS_GP_IMAGE_H
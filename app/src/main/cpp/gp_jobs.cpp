@@ -0,0 +1,143 @@
+//
+// Worker pool, see gp_jobs.h
+//
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "gp_platform.h"
+#include "gp_jobs.h"
+
+typedef struct {
+    JobFunction function;
+    void *user;
+    int count;
+    std::atomic<int> next;
+    // guarded by batches_mutex
+    int finished;
+    int active_workers;
+} JobBatch;
+
+static std::vector<std::thread> workers;
+static std::deque<JobBatch *> batches;
+static std::mutex batches_mutex;
+static std::condition_variable batches_changed;
+static std::condition_variable batch_finished;
+static bool shutting_down = false;
+
+// Claims and runs indices of batch until there are none left. Returns how many ran here.
+static int run_batch(JobBatch *batch) {
+    int ran = 0;
+    int index;
+    while ((index = batch->next.fetch_add(1)) < batch->count) {
+        batch->function(batch->user, index);
+        ran++;
+    }
+    return ran;
+}
+
+static void worker_main() {
+    while (true) {
+        JobBatch *batch;
+        {
+            std::unique_lock<std::mutex> lock(batches_mutex);
+            batches_changed.wait(lock, [] { return shutting_down || !batches.empty(); });
+            if (shutting_down) {
+                return;
+            }
+            batch = batches.front();
+            if (batch->next.load() >= batch->count) {
+                // every index is claimed, nothing left for this thread
+                batches.pop_front();
+                continue;
+            }
+            // keeps the batch alive in jobs_parallel_for until this thread lets go of it
+            batch->active_workers++;
+        }
+
+        int ran = run_batch(batch);
+
+        std::lock_guard<std::mutex> lock(batches_mutex);
+        batch->finished += ran;
+        batch->active_workers--;
+        if (batch->finished == batch->count && batch->active_workers == 0) {
+            batch_finished.notify_all();
+        }
+    }
+}
+
+void jobs_init(int worker_count) {
+    std::lock_guard<std::mutex> lock(batches_mutex);
+    if (!workers.empty()) {
+        return;
+    }
+    if (worker_count <= 0) {
+        worker_count = std::max(1, (int) std::thread::hardware_concurrency()) - 1;
+    }
+    shutting_down = false;
+    for (int i = 0; i < worker_count; ++i) {
+        workers.emplace_back(worker_main);
+    }
+    log_fmt("jobs_init: %d workers", worker_count);
+}
+
+void jobs_shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(batches_mutex);
+        shutting_down = true;
+    }
+    batches_changed.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+int jobs_worker_count() {
+    return (int) workers.size();
+}
+
+void jobs_parallel_for(int count, JobFunction function, void *user) {
+    if (count <= 0) {
+        return;
+    }
+
+    JobBatch batch;
+    batch.function = function;
+    batch.user = user;
+    batch.count = count;
+    batch.next = 0;
+    batch.finished = 0;
+    batch.active_workers = 0;
+
+    bool use_workers;
+    {
+        std::lock_guard<std::mutex> lock(batches_mutex);
+        use_workers = !workers.empty() && count > 1;
+        if (use_workers) {
+            batches.push_back(&batch);
+        }
+    }
+    if (use_workers) {
+        batches_changed.notify_all();
+    }
+
+    // the calling thread helps instead of sleeping
+    int ran = run_batch(&batch);
+
+    std::unique_lock<std::mutex> lock(batches_mutex);
+    batch.finished += ran;
+    batch_finished.wait(lock, [&batch] {
+        return batch.finished == batch.count && batch.active_workers == 0;
+    });
+    // workers may not have popped it yet
+    auto it = std::find(batches.begin(), batches.end(), &batch);
+    if (it != batches.end()) {
+        batches.erase(it);
+    }
+}
@@ -0,0 +1,21 @@
+//
+// Small worker pool for splitting CPU work (model parsing, image decoding) across cores.
+//
+
+#ifndef BLOCKS_GP_JOBS_H
+#define BLOCKS_GP_JOBS_H
+
+typedef void (*JobFunction)(void *user, int index);
+
+// Starts worker_count threads, 0 means one per core minus the calling thread. Calling it again is a no-op.
+void jobs_init(int worker_count);
+
+void jobs_shutdown();
+
+int jobs_worker_count();
+
+// Runs function(user, i) for every i in [0, count) on the workers and the calling thread and returns
+// once all of them finished. Safe to call from several threads at the same time.
+void jobs_parallel_for(int count, JobFunction function, void *user);
+
+#endif //BLOCKS_GP_JOBS_H
@@ -0,0 +1,171 @@
+//
+// KTX reader and writer, see gp_ktx.h
+//
+
+#include <cstdio>
+#include <cstring>
+
+#include "gp_platform.h"
+#include "gp_ktx.h"
+#include "gp_etc.h"
+
+static const uint8_t ktx_identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+#define KTX_ORIENTATION_KEY "KTXorientation"
+
+static size_t align4(size_t value) {
+    return (value + 3) & ~(size_t) 3;
+}
+
+// gl_texel_size of gp_gl.h
+static size_t ktx_texel_size(uint32_t format, uint32_t type) {
+    if (type == KTX_GL_UNSIGNED_SHORT_5_6_5 || type == KTX_GL_UNSIGNED_SHORT_4_4_4_4 ||
+        type == KTX_GL_UNSIGNED_SHORT_5_5_5_1) {
+        return 2;
+    }
+    switch (format) {
+        case KTX_GL_RGBA:
+            return 4;
+        case KTX_GL_RGB:
+            return 3;
+        case KTX_GL_LUMINANCE_ALPHA:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+// Whether image_size bytes hold a width x height level: ETC1 blocks, or rows tightly packed or padded to 4 bytes
+// (see upload_texture_data)
+static bool ktx_level_fits(const KtxTexture *texture, int width, int height, uint32_t image_size) {
+    if (texture->gl_type == 0) {
+        return image_size >= etc1_image_size(width, height);
+    }
+    size_t row_size = (size_t) width * ktx_texel_size(texture->gl_format, texture->gl_type);
+    return image_size == row_size * height || image_size >= align4(row_size) * height;
+}
+
+bool ktx_parse(const void *data, size_t size, KtxTexture *texture) {
+    memset(texture, 0, sizeof(KtxTexture));
+    if (size < sizeof(KtxHeader)) {
+        return false;
+    }
+    const auto *header = (const KtxHeader *) data;
+    if (memcmp(header->identifier, ktx_identifier, sizeof(ktx_identifier)) != 0) {
+        log_str("ktx_parse: not a KTX 1.1 file");
+        return false;
+    }
+    if (header->endianness != KTX_ENDIANNESS) {
+        log_str("ktx_parse: big endian files are not supported");
+        return false;
+    }
+    if (header->pixel_depth > 1 || header->array_element_count > 0 || header->face_count != 1) {
+        log_str("ktx_parse: only 2D textures are supported");
+        return false;
+    }
+    if (header->pixel_width == 0) {
+        log_str("ktx_parse: no width");
+        return false;
+    }
+    // the size of other block formats is not known here
+    if (header->gl_type == 0 && header->gl_internal_format != ETC1_RGB8_FORMAT) {
+        log_fmt("ktx_parse: compressed format 0x%x is not supported", header->gl_internal_format);
+        return false;
+    }
+    // 0 asks the loader to generate the levels, there is nothing to generate them from here
+    uint32_t level_count = header->level_count ? header->level_count : 1;
+    if (level_count > IMAGE_MAX_LEVELS) {
+        log_fmt("ktx_parse: %u levels", level_count);
+        return false;
+    }
+
+    texture->gl_type = header->gl_type;
+    texture->gl_format = header->gl_type ? header->gl_format : header->gl_internal_format;
+    texture->level_count = (int) level_count;
+
+    const auto *bytes = (const uint8_t *) data;
+    size_t offset = sizeof(KtxHeader) + header->key_value_data_size;
+    int width = (int) header->pixel_width;
+    int height = header->pixel_height ? (int) header->pixel_height : 1;
+    for (uint32_t i = 0; i < level_count; ++i) {
+        uint32_t image_size;
+        if (offset + sizeof(image_size) > size) {
+            log_fmt("ktx_parse: level %u is cut off", i);
+            return false;
+        }
+        memcpy(&image_size, bytes + offset, sizeof(image_size));
+        offset += sizeof(image_size);
+        if (offset + image_size > size) {
+            log_fmt("ktx_parse: level %u is cut off", i);
+            return false;
+        }
+        if (!ktx_level_fits(texture, width, height, image_size)) {
+            log_fmt("ktx_parse: level %u has %u bytes for %d x %d texels", i, image_size, width, height);
+            return false;
+        }
+
+        TextureLevel *level = &texture->levels[i];
+        level->width = width;
+        level->height = height;
+        level->data = bytes + offset;
+        level->size = image_size;
+
+        offset = align4(offset + image_size);
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    return true;
+}
+
+static void write_padding(FILE *file, size_t size) {
+    static const uint8_t zeros[4] = {0, 0, 0, 0};
+    fwrite(zeros, 1, align4(size) - size, file);
+}
+
+bool write_ktx(const char *file_name, uint32_t gl_type, uint32_t gl_format, uint32_t gl_internal_format,
+               uint32_t gl_base_internal_format, const TextureLevel *levels, int level_count,
+               const char *orientation) {
+    uint32_t key_value_size = 0;
+    if (orientation) {
+        key_value_size = (uint32_t) (strlen(KTX_ORIENTATION_KEY) + 1 + strlen(orientation) + 1);
+    }
+
+    KtxHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.identifier, ktx_identifier, sizeof(ktx_identifier));
+    header.endianness = KTX_ENDIANNESS;
+    header.gl_type = gl_type;
+    header.gl_type_size = 1;
+    header.gl_format = gl_format;
+    header.gl_internal_format = gl_internal_format;
+    header.gl_base_internal_format = gl_base_internal_format;
+    header.pixel_width = (uint32_t) levels[0].width;
+    header.pixel_height = (uint32_t) levels[0].height;
+    header.face_count = 1;
+    header.level_count = (uint32_t) level_count;
+    header.key_value_data_size = orientation ? (uint32_t) (sizeof(uint32_t) + align4(key_value_size)) : 0;
+
+    FILE *file = fopen(file_name, "wb");
+    if (!file) {
+        log_fmt("write_ktx: could not open %s", file_name);
+        return false;
+    }
+
+    fwrite(&header, sizeof(header), 1, file);
+    if (orientation) {
+        fwrite(&key_value_size, sizeof(key_value_size), 1, file);
+        fwrite(KTX_ORIENTATION_KEY, 1, strlen(KTX_ORIENTATION_KEY) + 1, file);
+        fwrite(orientation, 1, strlen(orientation) + 1, file);
+        write_padding(file, key_value_size);
+    }
+    for (int i = 0; i < level_count; ++i) {
+        auto image_size = (uint32_t) levels[i].size;
+        fwrite(&image_size, sizeof(image_size), 1, file);
+        fwrite(levels[i].data, 1, levels[i].size, file);
+        write_padding(file, levels[i].size);
+    }
+
+    bool written = ferror(file) == 0;
+    fclose(file);
+    return written;
+}
@@ -0,0 +1,73 @@
+//
+// KTX 1.1 texture containers (https://registry.khronos.org/KTX/specs/1.0/ktxspec.v1.html). Shipped textures
+// come with their full mip chain already in the GL format, they are parsed in place from the mapped file and
+// uploaded level by level without any decoding.
+//
+// [KtxHeader][key / value data][uint32 image_size][level 0][padding to 4]...[uint32 image_size][level n]...
+//
+// Only 2D textures (no arrays, no cube maps) in the little endian byte order of the writer are loaded.
+//
+
+#ifndef BLOCKS_GP_KTX_H
+#define BLOCKS_GP_KTX_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "gp_image.h"
+
+#define KTX_EXTENSION ".ktx"
+#define KTX_ENDIANNESS 0x04030201
+// Written by texture_convert for textures flipped on load (LOAD_TEXTURE_FLIP)
+#define KTX_ORIENTATION_FLIPPED "S=r,T=u"
+#define KTX_ORIENTATION_AS_IS "S=r,T=d"
+
+// GL enums of the formats texture_convert writes, the tools build without GL headers
+#define KTX_GL_UNSIGNED_BYTE 0x1401
+#define KTX_GL_RGB 0x1907
+#define KTX_GL_RGBA 0x1908
+#define KTX_GL_RGBA8 0x8058
+#define KTX_GL_LUMINANCE_ALPHA 0x190A
+#define KTX_GL_UNSIGNED_SHORT_4_4_4_4 0x8033
+#define KTX_GL_UNSIGNED_SHORT_5_5_5_1 0x8034
+#define KTX_GL_UNSIGNED_SHORT_5_6_5 0x8363
+
+typedef struct {
+    uint8_t identifier[12];
+    uint32_t endianness;
+    // 0 for compressed formats
+    uint32_t gl_type;
+    uint32_t gl_type_size;
+    // 0 for compressed formats
+    uint32_t gl_format;
+    uint32_t gl_internal_format;
+    uint32_t gl_base_internal_format;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t array_element_count;
+    uint32_t face_count;
+    uint32_t level_count;
+    uint32_t key_value_data_size;
+} KtxHeader;
+
+typedef struct {
+    uint32_t gl_type;
+    // what glTexImage2D / glCompressedTexImage2D take in ES 2, the internal format of compressed textures and
+    // the unsized format of the others
+    uint32_t gl_format;
+    int level_count;
+    // pointing into the file data
+    TextureLevel levels[IMAGE_MAX_LEVELS];
+} KtxTexture;
+
+// Fills texture with views into data, false when data is not a KTX file this loader supports
+bool ktx_parse(const void *data, size_t size, KtxTexture *texture);
+
+// Host side, used by tools/texture_convert. orientation is one of KTX_ORIENTATION_* or null.
+// gl_type and gl_format are 0 for compressed formats. Every level is written with 4 byte aligned rows as given.
+bool write_ktx(const char *file_name, uint32_t gl_type, uint32_t gl_format, uint32_t gl_internal_format,
+               uint32_t gl_base_internal_format, const TextureLevel *levels, int level_count,
+               const char *orientation);
+
+#endif //BLOCKS_GP_KTX_H
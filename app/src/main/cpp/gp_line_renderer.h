@@ -14,7 +14,7 @@ typedef struct {
     int elements_per_vertex;
     float *vertex_data;
     float *push_ptr;
-    GLuint shader;
+    ShaderProgram shader;
 } LineRenderer;
 
 void line_renderer_init(LineRenderer *renderer, int max_lines) {
@@ -44,7 +44,7 @@ void line_renderer_init(LineRenderer *renderer, int max_lines) {
             "   gl_FragColor = vec4(1.0,0.0,0.0, 1.0);;"
             "}\n";
 
-    renderer->shader = create_program(vs_source, fs_source);
+    shader_program_create(&renderer->shader, vs_source, fs_source);
 
     renderer->current_lines = 0;
     renderer->max_lines = max_lines;
@@ -110,29 +110,21 @@ line_renderer_push_point(LineRenderer *renderer, float px, float py, float pz, i
 inline void line_renderer_render(LineRenderer *renderer, float model_matrix[], float view_matrix[],
                                  float projection_matrix[]) {
     GL_ERR;
-    GLuint shader = renderer->shader;
-    glUseProgram(shader);
-
-    glUniformMatrix4fv(
-            glGetUniformLocation(shader, "model_matrix"),
-            1,
-            GL_FALSE,
-            model_matrix);
-    glUniformMatrix4fv(
-            glGetUniformLocation(shader, "view_matrix"),
-            1,
-            GL_FALSE,
-            view_matrix);
-    glUniformMatrix4fv(
-            glGetUniformLocation(shader, "projection_matrix"),
-            1,
-            GL_FALSE, projection_matrix);
-
-    GLint position = glGetAttribLocation(shader, "vertex_position");
+    ShaderProgram *shader = &renderer->shader;
+    gl_state_use_program(shader->program);
+
+    shader_set_mat4(shader, SHADER_UNIFORM_MODEL_MATRIX, model_matrix);
+    shader_set_mat4(shader, SHADER_UNIFORM_VIEW_MATRIX, view_matrix);
+    shader_set_mat4(shader, SHADER_UNIFORM_PROJECTION_MATRIX, projection_matrix);
+
+    GLint position = shader->attributes[SHADER_ATTRIBUTE_POSITION];
     // GLint color = glGetAttribLocation(shader, "vertex_color_index");
+    // client side arrays
+    gl_state_bind_vertex_array(0);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, 0);
     int bytes_per_float = 4;
     int stride = bytes_per_float * renderer->elements_per_vertex;
-    glEnableVertexAttribArray(position);
+    gl_state_vertex_attrib_array(position, true);
     glVertexAttribPointer(position, GP_LINE_RENDERER_POS_ELEMS, GL_FLOAT, GL_FALSE, stride,
                           renderer->vertex_data);
     //glEnableVertexAttribArray(color);
@@ -140,9 +132,6 @@ inline void line_renderer_render(LineRenderer *renderer, float model_matrix[], f
     GL_ERR;
     glDrawArrays(GL_LINES, 0, renderer->current_lines * 2);
 
-    GL_ERR;
-    glUseProgram(0);
-
     GL_ERR;
 }
 
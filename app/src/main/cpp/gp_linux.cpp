@@ -0,0 +1,133 @@
+//
+// Host platform layer. Only used by the tools in /tools, the game itself runs on gp_android.cpp.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include <cstdint>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gp_platform.h"
+
+// Images are decoded on several threads at once, the failure string is a global stb_image 2.23 writes unguarded.
+// Without the strings its setter stbi__err is never called.
+#define STBI_NO_FAILURE_STRINGS
+#define STB_IMAGE_IMPLEMENTATION
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#include "stb_image.h"
+#pragma GCC diagnostic pop
+
+void linux_log_fmt(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    printf("\n");
+}
+
+void linux_log_str(const char *str) {
+    printf("%s\n", str);
+}
+
+char *linux_read_entire_file(const char *file_name, char mode) {
+    FILE *file = fopen(file_name, "rb");
+    if (!file) {
+        linux_log_fmt("linux_read_entire_file: could not open %s", file_name);
+        return nullptr;
+    }
+
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        length = ftell(file);
+    }
+    if (length < 0 || fseek(file, 0, SEEK_SET) != 0) {
+        linux_log_fmt("linux_read_entire_file: could not size %s", file_name);
+        fclose(file);
+        return nullptr;
+    }
+    auto file_length = static_cast<size_t>(length);
+
+    char *file_content = (char *) malloc(file_length + 1);
+    size_t read = file_content ? fread(file_content, 1, file_length, file) : 0;
+    fclose(file);
+    if (read != file_length) {
+        linux_log_fmt("linux_read_entire_file: read %d of %d bytes of %s", (int) read, (int) file_length, file_name);
+        free(file_content);
+        return nullptr;
+    }
+
+    file_content[file_length] = '\0';
+
+    return file_content;
+}
+
+bool linux_map_file(const char *file_name, FileView *view) {
+    view->data = nullptr;
+    view->size = 0;
+    view->handle = nullptr;
+
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    view->data = data;
+    view->size = (size_t) st.st_size;
+    return true;
+}
+
+void linux_unmap_file(FileView *view) {
+    if (view->data) {
+        munmap((void *) view->data, view->size);
+    }
+    view->data = nullptr;
+    view->size = 0;
+    view->handle = nullptr;
+}
+
+static int linux_reader_read(void *handle, char *buffer, int size) {
+    ssize_t read_bytes;
+    do {
+        read_bytes = read((int) (intptr_t) handle, buffer, (size_t) size);
+    } while (read_bytes < 0 && errno == EINTR);
+    return read_bytes >= 0 ? (int) read_bytes : -1;
+}
+
+static void linux_reader_close(void *handle) {
+    close((int) (intptr_t) handle);
+}
+
+bool linux_open_file_reader(const char *file_name, FileReader *reader) {
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    reader->handle = (void *) (intptr_t) fd;
+    reader->read = linux_reader_read;
+    reader->close = linux_reader_close;
+    return true;
+}
+
+FILE *linux_open_asset_stdio(const char *file_name) {
+    return fopen(file_name, "rb");
+}
@@ -0,0 +1,190 @@
+//
+// Loader thread, see gp_loader.h
+//
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+#include "gp_platform.h"
+#include "gp_jobs.h"
+#include "gp_loader.h"
+
+// Single producer single consumer ring. Only the producer writes tail, only the consumer writes head.
+typedef struct {
+    LoaderItem *items[LOADER_QUEUE_CAPACITY];
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+} LoaderQueue;
+
+static bool queue_push(LoaderQueue *queue, LoaderItem *item) {
+    uint32_t tail = queue->tail.load(std::memory_order_relaxed);
+    if (tail - queue->head.load(std::memory_order_acquire) == LOADER_QUEUE_CAPACITY) {
+        return false;
+    }
+    queue->items[tail % LOADER_QUEUE_CAPACITY] = item;
+    // publishes the item and everything written to it
+    queue->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+static LoaderItem *queue_pop(LoaderQueue *queue) {
+    uint32_t head = queue->head.load(std::memory_order_relaxed);
+    if (head == queue->tail.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    LoaderItem *item = queue->items[head % LOADER_QUEUE_CAPACITY];
+    queue->head.store(head + 1, std::memory_order_release);
+    return item;
+}
+
+static bool queue_empty(LoaderQueue *queue) {
+    return queue->head.load(std::memory_order_acquire) == queue->tail.load(std::memory_order_acquire);
+}
+
+// render thread -> loader jobs, the jobs take turns popping under requests_pop_mutex
+static LoaderQueue requests;
+static std::mutex requests_pop_mutex;
+// loader jobs -> render thread, the jobs take turns pushing under results_push_mutex
+static LoaderQueue results;
+static std::mutex results_push_mutex;
+
+static std::thread loader_thread;
+// only used to sleep while there are no requests, the queues themselves take no lock
+static std::mutex wake_mutex;
+static std::condition_variable wake;
+static std::atomic<bool> shutting_down(false);
+static bool parallel = true;
+static int pending = 0;
+
+double loader_time_ms() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<double, std::milli>(now).count();
+}
+
+static LoaderItem *pop_request() {
+    std::lock_guard<std::mutex> lock(requests_pop_mutex);
+    return queue_pop(&requests);
+}
+
+static bool push_result(LoaderItem *item) {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(results_push_mutex);
+            if (queue_push(&results, item)) {
+                return true;
+            }
+        }
+        // the render thread is behind on uploads
+        if (shutting_down.load()) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// Loads requests until there are none left, each result is handed to the render thread as soon as it is done
+static void load_requests_job(void *user, int index) {
+    LoaderItem *item;
+    while (!shutting_down.load() && (item = pop_request())) {
+        double start = loader_time_ms();
+        item->load(item);
+        item->load_ms = (float) (loader_time_ms() - start);
+        if (!push_result(item)) {
+            return;
+        }
+    }
+}
+
+static void loader_main() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake.wait(lock, [] { return shutting_down.load() || !queue_empty(&requests); });
+        }
+        if (shutting_down.load()) {
+            return;
+        }
+
+        if (parallel) {
+            // one job per thread, every job keeps popping so a slow load does not hold back the rest
+            jobs_parallel_for(jobs_worker_count() + 1, load_requests_job, nullptr);
+        } else {
+            load_requests_job(nullptr, 0);
+        }
+    }
+}
+
+void loader_init(bool parallel_loads) {
+    if (loader_thread.joinable()) {
+        return;
+    }
+    shutting_down = false;
+    parallel = parallel_loads;
+    loader_thread = std::thread(loader_main);
+}
+
+void loader_shutdown() {
+    if (!loader_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        shutting_down = true;
+    }
+    wake.notify_one();
+    loader_thread.join();
+}
+
+bool loader_submit(const char *path, LoaderFunction load, LoaderFunction upload, void *target, int flags) {
+    assert(loader_thread.joinable());
+    size_t length = strlen(path);
+    if (length >= LOADER_PATH_LENGTH) {
+        log_fmt("loader_submit: path longer than %d characters, dropping %s", LOADER_PATH_LENGTH - 1, path);
+        return false;
+    }
+    auto *item = (LoaderItem *) malloc(sizeof(LoaderItem));
+    memset(item, 0, sizeof(LoaderItem));
+    memcpy(item->path, path, length + 1);
+    item->load = load;
+    item->upload = upload;
+    item->target = target;
+    item->flags = flags;
+
+    if (!queue_push(&requests, item)) {
+        log_fmt("loader_submit: queue full, dropping %s", path);
+        free(item);
+        return false;
+    }
+    pending++;
+    {
+        // taking the lock orders the push before the wait predicate check, no lost wake ups
+        std::lock_guard<std::mutex> lock(wake_mutex);
+    }
+    wake.notify_one();
+    return true;
+}
+
+int loader_drain(float budget_ms) {
+    double start = loader_time_ms();
+    int uploaded = 0;
+    LoaderItem *item;
+    while ((uploaded == 0 || loader_time_ms() - start < budget_ms) && (item = queue_pop(&results))) {
+        double upload_start = loader_time_ms();
+        item->upload(item);
+        log_fmt("loader: %s load %.2f ms upload %.2f ms", item->path, item->load_ms,
+                loader_time_ms() - upload_start);
+        free(item);
+        pending--;
+        uploaded++;
+    }
+    return uploaded;
+}
+
+int loader_pending() {
+    return pending;
+}
@@ -0,0 +1,51 @@
+//
+// Background asset loading. File I/O, parsing and decoding run on a loader thread (fanned out over the jobs
+// pool), the results come back through a queue and are handed to GL on the render thread, one after another,
+// within a per frame time budget.
+//
+
+#ifndef BLOCKS_GP_LOADER_H
+#define BLOCKS_GP_LOADER_H
+
+#define LOADER_PATH_LENGTH 128
+// Requests in flight in each direction
+#define LOADER_QUEUE_CAPACITY 64
+
+typedef struct LoaderItem LoaderItem;
+
+typedef void (*LoaderFunction)(LoaderItem *item);
+
+struct LoaderItem {
+    char path[LOADER_PATH_LENGTH];
+    // Loader thread or a jobs worker, fills payload from path. No GL calls, may run next to other loads.
+    LoaderFunction load;
+    // Render thread, hands payload to GL / target and releases it.
+    LoaderFunction upload;
+    // Where the result ends up (a texture name, a model, ...), owned by the caller
+    void *target;
+    void *payload;
+    int flags;
+    float load_ms;
+};
+
+// Starts the loader thread. parallel_loads runs the queued loads at the same time on the jobs pool (see
+// gp_jobs.h, jobs_init must run first), otherwise one after another. Calling it again is a no-op.
+void loader_init(bool parallel_loads = true);
+
+void loader_shutdown();
+
+// Render thread only. Queues path for load on the loader thread and upload on a later loader_drain. False when
+// the queue is full or path does not fit LOADER_PATH_LENGTH.
+bool loader_submit(const char *path, LoaderFunction load, LoaderFunction upload, void *target, int flags);
+
+// Render thread only. Runs the uploads of finished items until budget_ms is spent, at least one when any
+// is ready. Returns the number of uploads.
+int loader_drain(float budget_ms);
+
+// Submitted items that were not uploaded yet
+int loader_pending();
+
+// Monotonic clock for the budgets and timings
+double loader_time_ms();
+
+#endif //BLOCKS_GP_LOADER_H
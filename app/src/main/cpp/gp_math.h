@@ -127,4 +127,32 @@ push_textured_quad_scaled_arr(float *v, float x0, float y0, float x1, float y1,
                                   s1, t1);
 }
 
+// True when the box is completely outside one of the clip planes of model_view_projection.
+// Conservative, boxes crossing a frustum corner may still be reported as visible.
+bool aabb_outside_frustum(const float model_view_projection[], const float aabb_min[3], const float aabb_max[3]) {
+    float4 corners[8];
+    for (int i = 0; i < 8; ++i) {
+        float4 corner = {(i & 1) ? aabb_max[0] : aabb_min[0],
+                         (i & 2) ? aabb_max[1] : aabb_min[1],
+                         (i & 4) ? aabb_max[2] : aabb_min[2],
+                         1.0f};
+        m_mat4_transform4(&corners[i], model_view_projection, &corner);
+    }
+
+    // -w <= x, y, z <= w
+    for (int plane = 0; plane < 6; ++plane) {
+        int axis = plane / 2;
+        float sign = (plane & 1) ? -1.0f : 1.0f;
+        bool all_outside = true;
+        for (int i = 0; i < 8 && all_outside; ++i) {
+            float value = axis == 0 ? corners[i].x : (axis == 1 ? corners[i].y : corners[i].z);
+            all_outside = sign * value < -corners[i].w;
+        }
+        if (all_outside) {
+            return true;
+        }
+    }
+    return false;
+}
+
 #endif //BLOCKS_GP_MATH_H
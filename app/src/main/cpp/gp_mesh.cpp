@@ -0,0 +1,952 @@
+//
+// Mesh processing, see gp_mesh.h
+//
+
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+#include <cassert>
+#include <cmath>
+
+#include "gp_platform.h"
+#include "gp_mesh.h"
+
+static uint32_t hash_vertex(const float *vertex, int elems) {
+    // FNV-1a over the raw bits, identical vertices always have identical bits
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < elems; ++i) {
+        uint32_t bits;
+        memcpy(&bits, &vertex[i], sizeof(bits));
+        hash = (hash ^ bits) * 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+static uint32_t next_power_of_two(uint32_t x) {
+    uint32_t result = 1;
+    while (result < x) result <<= 1;
+    return result;
+}
+
+uint32_t mesh_index(const SModelData *model, int i) {
+    if (model->index_size == 2) {
+        return ((const uint16_t *) model->indices)[i];
+    }
+    return ((const uint32_t *) model->indices)[i];
+}
+
+int mesh_vertex_cache_misses(const SModelData *model, int first_index, int index_count, int cache_size) {
+    if (model->index_count == 0) {
+        return index_count;
+    }
+
+    uint32_t cache[MESH_VERTEX_CACHE_SIZE * 4];
+    assert(cache_size <= (int) (sizeof(cache) / sizeof(cache[0])));
+    int cached = 0;
+    int next = 0;
+    int misses = 0;
+
+    for (int i = first_index; i < first_index + index_count; ++i) {
+        uint32_t index = mesh_index(model, i);
+        bool hit = false;
+        for (int c = 0; c < cached && !hit; ++c) {
+            hit = cache[c] == index;
+        }
+        if (hit) continue;
+
+        misses++;
+        cache[next] = index;
+        next = (next + 1) % cache_size;
+        if (cached < cache_size) cached++;
+    }
+    return misses;
+}
+
+bool mesh_weld(SModelData *model, bool allow_32bit_indices, MeshWeldStats *stats) {
+    assert(model->index_count == 0 && model->data);
+    int stride = model->elems_stride;
+    int vertex_count = model->vertex_number;
+
+    auto *unique_data = (float *) malloc(sizeof(float) * model->size);
+    auto *indices = (uint32_t *) malloc(sizeof(uint32_t) * vertex_count);
+
+    int largest_submodel = 0;
+    for (int s = 0; s < model->submodel_count; ++s) {
+        largest_submodel = largest_submodel > (int) model->submodels[s].vertex_count ? largest_submodel : (int) model->submodels[s].vertex_count;
+    }
+    uint32_t table_size = next_power_of_two((uint32_t) largest_submodel * 2 + 1);
+    uint32_t table_mask = table_size - 1;
+    auto *table = (int32_t *) malloc(sizeof(int32_t) * table_size);
+
+    int unique_count = 0;
+    int index_count = 0;
+
+    // Submodels are welded on their own so each keeps contiguous vertex and index ranges
+    for (int s = 0; s < model->submodel_count; ++s) {
+        SModelSubmodel *submodel = &model->submodels[s];
+        memset(table, 0xff, sizeof(int32_t) * table_size);
+        int first_unique = unique_count;
+        int first_index = index_count;
+
+        for (uint32_t v = submodel->first_vertex; v < submodel->first_vertex + submodel->vertex_count; ++v) {
+            const float *vertex = model->data + v * stride;
+            uint32_t slot = hash_vertex(vertex, stride) & table_mask;
+            while (true) {
+                int32_t existing = table[slot];
+                if (existing < 0) {
+                    memcpy(unique_data + unique_count * stride, vertex, sizeof(float) * stride);
+                    table[slot] = unique_count;
+                    indices[index_count++] = (uint32_t) unique_count++;
+                    break;
+                }
+                if (memcmp(unique_data + existing * stride, vertex, sizeof(float) * stride) == 0) {
+                    indices[index_count++] = (uint32_t) existing;
+                    break;
+                }
+                slot = (slot + 1) & table_mask;
+            }
+        }
+
+        submodel->first_vertex = (uint32_t) first_unique;
+        submodel->vertex_count = (uint32_t) (unique_count - first_unique);
+        submodel->first_index = (uint32_t) first_index;
+        submodel->index_count = (uint32_t) (index_count - first_index);
+    }
+    free(table);
+
+    bool fits_16bit = unique_count <= 0xFFFF + 1;
+    if (!fits_16bit && !allow_32bit_indices) {
+        log_fmt("mesh_weld: %d unique vertices need 32 bit indices, keeping the model unindexed", unique_count);
+        // put the submodel ranges back
+        uint32_t first_vertex = 0;
+        for (int s = 0; s < model->submodel_count; ++s) {
+            SModelSubmodel *submodel = &model->submodels[s];
+            submodel->vertex_count = submodel->index_count;
+            submodel->first_vertex = first_vertex;
+            submodel->first_index = 0;
+            submodel->index_count = 0;
+            first_vertex += submodel->vertex_count;
+        }
+        free(unique_data);
+        free(indices);
+        return false;
+    }
+
+    if (fits_16bit) {
+        auto *indices_16 = (uint16_t *) malloc(sizeof(uint16_t) * index_count);
+        for (int i = 0; i < index_count; ++i) {
+            indices_16[i] = (uint16_t) indices[i];
+        }
+        free(indices);
+        model->indices = indices_16;
+        model->index_size = 2;
+    } else {
+        model->indices = indices;
+        model->index_size = 4;
+    }
+    model->index_count = index_count;
+
+    // The welded copy replaces the original vertices, mapped or not
+    if (model->mapping.data) {
+        unmap_file(&model->mapping);
+    } else {
+        free(model->data);
+    }
+    model->data = (float *) realloc(unique_data, sizeof(float) * unique_count * stride);
+    model->vertex_number = unique_count;
+    model->size = unique_count * stride;
+
+    if (stats) {
+        stats->vertex_bytes_before = (int) (sizeof(float) * vertex_count * stride);
+        stats->vertex_bytes_after = (int) (sizeof(float) * model->size);
+        stats->index_bytes = index_count * model->index_size;
+        stats->shaded_vertices_before = vertex_count;
+        stats->shaded_vertices_after = 0;
+        for (int s = 0; s < model->submodel_count; ++s) {
+            stats->shaded_vertices_after += mesh_vertex_cache_misses(model, model->submodels[s].first_index,
+                                                                     model->submodels[s].index_count,
+                                                                     MESH_VERTEX_CACHE_SIZE);
+        }
+    }
+    return true;
+}
+
+MeshCacheStats mesh_cache_stats(const SModelData *model, int cache_size) {
+    int misses = 0;
+    int triangles = 0;
+    for (int s = 0; s < model->submodel_count; ++s) {
+        const SModelSubmodel *submodel = &model->submodels[s];
+        if (model->index_count) {
+            misses += mesh_vertex_cache_misses(model, submodel->first_index, submodel->index_count, cache_size);
+            triangles += submodel->index_count / 3;
+        } else {
+            misses += submodel->vertex_count;
+            triangles += submodel->vertex_count / 3;
+        }
+    }
+
+    MeshCacheStats stats;
+    stats.acmr = triangles ? (float) misses / triangles : 0.0f;
+    stats.atvr = model->vertex_number ? (float) misses / model->vertex_number : 0.0f;
+    return stats;
+}
+
+static void set_mesh_index(SModelData *model, int i, uint32_t value) {
+    if (model->index_size == 2) {
+        ((uint16_t *) model->indices)[i] = (uint16_t) value;
+    } else {
+        ((uint32_t *) model->indices)[i] = value;
+    }
+}
+
+// Forsyth's scoring, the constants are the ones from the original article
+#define FORSYTH_CACHE_SIZE 32
+#define FORSYTH_CACHE_DECAY_POWER 1.5f
+#define FORSYTH_LAST_TRIANGLE_SCORE 0.75f
+#define FORSYTH_VALENCE_BOOST_SCALE 2.0f
+#define FORSYTH_VALENCE_BOOST_POWER 0.5f
+
+static float forsyth_vertex_score(int cache_position, int remaining_triangles) {
+    if (remaining_triangles == 0) {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cache_position >= 0) {
+        if (cache_position < 3) {
+            // the triangle that was just drawn, deliberately not preferred over the rest of the cache
+            score = FORSYTH_LAST_TRIANGLE_SCORE;
+        } else {
+            float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+            score = powf(1.0f - (cache_position - 3) * scaler, FORSYTH_CACHE_DECAY_POWER);
+        }
+    }
+    // prefer finishing off vertices with few triangles left
+    score += FORSYTH_VALENCE_BOOST_SCALE * powf((float) remaining_triangles, -FORSYTH_VALENCE_BOOST_POWER);
+    return score;
+}
+
+// Reorders the triangles in [first_index, first_index + index_count), all referencing [first_vertex, first_vertex + vertex_count)
+static void forsyth_optimize(SModelData *model, int first_index, int index_count, int first_vertex, int vertex_count) {
+    int triangle_count = index_count / 3;
+    if (triangle_count < 2) {
+        return;
+    }
+
+    auto *triangles = (uint32_t *) malloc(sizeof(uint32_t) * index_count);
+    for (int i = 0; i < index_count; ++i) {
+        triangles[i] = mesh_index(model, first_index + i) - first_vertex;
+    }
+
+    // per vertex triangle lists
+    auto *remaining = (int *) calloc((size_t) vertex_count, sizeof(int));
+    auto *list_offset = (int *) malloc(sizeof(int) * (vertex_count + 1));
+    auto *triangle_lists = (int *) malloc(sizeof(int) * index_count);
+    for (int i = 0; i < index_count; ++i) {
+        remaining[triangles[i]]++;
+    }
+    list_offset[0] = 0;
+    for (int v = 0; v < vertex_count; ++v) {
+        list_offset[v + 1] = list_offset[v] + remaining[v];
+    }
+    auto *list_fill = (int *) calloc((size_t) vertex_count, sizeof(int));
+    for (int i = 0; i < index_count; ++i) {
+        uint32_t v = triangles[i];
+        triangle_lists[list_offset[v] + list_fill[v]++] = i / 3;
+    }
+    free(list_fill);
+
+    auto *cache_position = (int *) malloc(sizeof(int) * vertex_count);
+    auto *vertex_score = (float *) malloc(sizeof(float) * vertex_count);
+    for (int v = 0; v < vertex_count; ++v) {
+        cache_position[v] = -1;
+        vertex_score[v] = forsyth_vertex_score(-1, remaining[v]);
+    }
+
+    auto *triangle_score = (float *) malloc(sizeof(float) * triangle_count);
+    auto *triangle_added = (bool *) calloc((size_t) triangle_count, sizeof(bool));
+    for (int t = 0; t < triangle_count; ++t) {
+        triangle_score[t] = vertex_score[triangles[t * 3]] + vertex_score[triangles[t * 3 + 1]] +
+                            vertex_score[triangles[t * 3 + 2]];
+    }
+
+    // three extra slots for the vertices pushed out by the newest triangle
+    int cache[FORSYTH_CACHE_SIZE + 3];
+    int cache_count = 0;
+
+    int best_triangle = 0;
+    for (int t = 1; t < triangle_count; ++t) {
+        if (triangle_score[t] > triangle_score[best_triangle]) best_triangle = t;
+    }
+
+    int scan_cursor = 0;
+    int written = 0;
+    while (best_triangle >= 0) {
+        triangle_added[best_triangle] = true;
+        for (int c = 0; c < 3; ++c) {
+            uint32_t v = triangles[best_triangle * 3 + c];
+            set_mesh_index(model, first_index + written++, v + first_vertex);
+
+            // remove the triangle from the vertex list
+            int *list = triangle_lists + list_offset[v];
+            for (int i = 0; i < remaining[v]; ++i) {
+                if (list[i] == best_triangle) {
+                    list[i] = list[remaining[v] - 1];
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        // move the triangle vertices to the front of the cache
+        int new_cache[FORSYTH_CACHE_SIZE + 3];
+        int new_count = 0;
+        for (int c = 0; c < 3; ++c) {
+            new_cache[new_count++] = (int) triangles[best_triangle * 3 + c];
+        }
+        for (int c = 0; c < cache_count; ++c) {
+            int v = cache[c];
+            if (v != new_cache[0] && v != new_cache[1] && v != new_cache[2]) {
+                new_cache[new_count++] = v;
+            }
+        }
+
+        // rescore everything touched, vertices falling out of the cache lose their cache bonus
+        best_triangle = -1;
+        float best_score = -1.0f;
+        for (int c = 0; c < new_count; ++c) {
+            int v = new_cache[c];
+            cache_position[v] = c < FORSYTH_CACHE_SIZE ? c : -1;
+            float score = forsyth_vertex_score(cache_position[v], remaining[v]);
+            float delta = score - vertex_score[v];
+            vertex_score[v] = score;
+
+            int *list = triangle_lists + list_offset[v];
+            for (int i = 0; i < remaining[v]; ++i) {
+                int t = list[i];
+                triangle_score[t] += delta;
+                if (c < FORSYTH_CACHE_SIZE && triangle_score[t] > best_score) {
+                    best_score = triangle_score[t];
+                    best_triangle = t;
+                }
+            }
+        }
+        cache_count = new_count < FORSYTH_CACHE_SIZE ? new_count : FORSYTH_CACHE_SIZE;
+        memcpy(cache, new_cache, sizeof(int) * cache_count);
+
+        if (best_triangle < 0) {
+            // nothing left around the cache, continue with any triangle that is not drawn yet
+            while (scan_cursor < triangle_count && triangle_added[scan_cursor]) scan_cursor++;
+            if (scan_cursor < triangle_count) best_triangle = scan_cursor;
+        }
+    }
+    assert(written == triangle_count * 3);
+
+    free(triangles);
+    free(remaining);
+    free(list_offset);
+    free(triangle_lists);
+    free(cache_position);
+    free(vertex_score);
+    free(triangle_score);
+    free(triangle_added);
+}
+
+// Renumbers the vertices of a submodel in the order the index buffer first touches them
+static void optimize_vertex_fetch(SModelData *model, const SModelSubmodel *submodel) {
+    int stride = model->elems_stride;
+    int first_vertex = (int) submodel->first_vertex;
+    int vertex_count = (int) submodel->vertex_count;
+
+    auto *remap = (int32_t *) malloc(sizeof(int32_t) * vertex_count);
+    memset(remap, 0xff, sizeof(int32_t) * vertex_count);
+    auto *reordered = (float *) malloc(sizeof(float) * vertex_count * stride);
+
+    int next = 0;
+    for (uint32_t i = submodel->first_index; i < submodel->first_index + submodel->index_count; ++i) {
+        int v = (int) mesh_index(model, i) - first_vertex;
+        if (remap[v] < 0) {
+            remap[v] = next;
+            memcpy(reordered + next * stride, model->data + (first_vertex + v) * stride, sizeof(float) * stride);
+            next++;
+        }
+        set_mesh_index(model, i, (uint32_t) (remap[v] + first_vertex));
+    }
+    // vertices no triangle uses go to the end
+    for (int v = 0; v < vertex_count; ++v) {
+        if (remap[v] < 0) {
+            memcpy(reordered + next * stride, model->data + (first_vertex + v) * stride, sizeof(float) * stride);
+            next++;
+        }
+    }
+
+    memcpy(model->data + first_vertex * stride, reordered, sizeof(float) * vertex_count * stride);
+    free(reordered);
+    free(remap);
+}
+
+void mesh_optimize(SModelData *model) {
+    if (model->index_count == 0) {
+        return;
+    }
+    // the index and vertex buffers are rewritten in place
+    assert(!model->mapping.data && model->data);
+
+    for (int s = 0; s < model->submodel_count; ++s) {
+        const SModelSubmodel *submodel = &model->submodels[s];
+        // renumbering the vertices would break the detail levels, build them afterwards
+        assert(submodel->lod_count == 0);
+        forsyth_optimize(model, (int) submodel->first_index, (int) submodel->index_count,
+                         (int) submodel->first_vertex, (int) submodel->vertex_count);
+        optimize_vertex_fetch(model, submodel);
+    }
+}
+
+
+// Plane quadrics (Garland / Heckbert), the symmetric 4x4 matrix is stored as its upper triangle
+typedef struct {
+    double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+    double weight;
+} Quadric;
+
+static void quadric_add_plane(Quadric *q, double a, double b, double c, double d, double weight) {
+    q->xx += weight * a * a;
+    q->xy += weight * a * b;
+    q->xz += weight * a * c;
+    q->xw += weight * a * d;
+    q->yy += weight * b * b;
+    q->yz += weight * b * c;
+    q->yw += weight * b * d;
+    q->zz += weight * c * c;
+    q->zw += weight * c * d;
+    q->ww += weight * d * d;
+    q->weight += weight;
+}
+
+static void quadric_add(Quadric *q, const Quadric *other) {
+    q->xx += other->xx;
+    q->xy += other->xy;
+    q->xz += other->xz;
+    q->xw += other->xw;
+    q->yy += other->yy;
+    q->yz += other->yz;
+    q->yw += other->yw;
+    q->zz += other->zz;
+    q->zw += other->zw;
+    q->ww += other->ww;
+    q->weight += other->weight;
+}
+
+// Area weighted mean of the squared distances from p to the planes
+static double quadric_error(const Quadric *q, const float p[3]) {
+    double x = p[0];
+    double y = p[1];
+    double z = p[2];
+    double error = q->xx * x * x + 2 * q->xy * x * y + 2 * q->xz * x * z + 2 * q->xw * x +
+                   q->yy * y * y + 2 * q->yz * y * z + 2 * q->yw * y +
+                   q->zz * z * z + 2 * q->zw * z + q->ww;
+    return q->weight > 0.0 ? fabs(error) / q->weight : 0.0;
+}
+
+static void triangle_cross(const float *a, const float *b, const float *c, double n[3]) {
+    double ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    double ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    n[0] = ab[1] * ac[2] - ab[2] * ac[1];
+    n[1] = ab[2] * ac[0] - ab[0] * ac[2];
+    n[2] = ab[0] * ac[1] - ab[1] * ac[0];
+}
+
+typedef struct {
+    double cost;
+    int from;
+    int to;
+} MeshCollapse;
+
+static int compare_collapses(const void *a, const void *b) {
+    double cost_a = ((const MeshCollapse *) a)->cost;
+    double cost_b = ((const MeshCollapse *) b)->cost;
+    return cost_a < cost_b ? -1 : (cost_a > cost_b ? 1 : 0);
+}
+
+static int compare_edges(const void *a, const void *b) {
+    uint64_t edge_a = *(const uint64_t *) a;
+    uint64_t edge_b = *(const uint64_t *) b;
+    return edge_a < edge_b ? -1 : (edge_a > edge_b ? 1 : 0);
+}
+
+// Number of times edge is in the sorted edges
+static int count_edge(const uint64_t *edges, int edge_count, uint64_t edge) {
+    int low = 0;
+    int high = edge_count;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (edges[middle] < edge) low = middle + 1;
+        else high = middle;
+    }
+    int count = 0;
+    while (low + count < edge_count && edges[low + count] == edge) count++;
+    return count;
+}
+
+// Marks the vertices that must not move: the ones sharing their position with another vertex (uv or normal
+// seams) and the ones on open or non manifold edges.
+static void lock_seams_and_borders(const float *data, int stride, const uint32_t *indices, int index_count,
+                                   int vertex_count, bool *locked) {
+    auto *position_id = (int32_t *) malloc(sizeof(int32_t) * vertex_count);
+    auto *position_uses = (int32_t *) calloc((size_t) vertex_count, sizeof(int32_t));
+    uint32_t table_size = next_power_of_two((uint32_t) vertex_count * 2 + 1);
+    uint32_t table_mask = table_size - 1;
+    auto *table = (int32_t *) malloc(sizeof(int32_t) * table_size);
+    memset(table, 0xff, sizeof(int32_t) * table_size);
+
+    for (int v = 0; v < vertex_count; ++v) {
+        const float *position = data + v * stride;
+        uint32_t slot = hash_vertex(position, 3) & table_mask;
+        while (table[slot] >= 0 && memcmp(data + table[slot] * stride, position, sizeof(float) * 3) != 0) {
+            slot = (slot + 1) & table_mask;
+        }
+        if (table[slot] < 0) table[slot] = v;
+        position_id[v] = table[slot];
+        position_uses[table[slot]]++;
+    }
+    for (int v = 0; v < vertex_count; ++v) {
+        locked[v] = position_uses[position_id[v]] > 1;
+    }
+
+    // directed edges between positions, an edge without its reverse is on a border
+    auto *edges = (uint64_t *) malloc(sizeof(uint64_t) * index_count);
+    for (int i = 0; i < index_count; ++i) {
+        int next = i % 3 == 2 ? i - 2 : i + 1;
+        edges[i] = ((uint64_t) position_id[indices[i]] << 32) | (uint32_t) position_id[indices[next]];
+    }
+    qsort(edges, (size_t) index_count, sizeof(uint64_t), compare_edges);
+    for (int i = 0; i < index_count; ++i) {
+        int next = i % 3 == 2 ? i - 2 : i + 1;
+        uint64_t a = (uint64_t) position_id[indices[i]];
+        uint64_t b = (uint64_t) position_id[indices[next]];
+        if (count_edge(edges, index_count, (a << 32) | b) != 1 || count_edge(edges, index_count, (b << 32) | a) != 1) {
+            locked[indices[i]] = true;
+            locked[indices[next]] = true;
+        }
+    }
+
+    free(edges);
+    free(table);
+    free(position_uses);
+    free(position_id);
+}
+
+// Collapses edges of the triangles in indices (local to the vertex_count vertices at data) until at most
+// target_index_count indices are left or nothing can collapse anymore. Returns the new index count, *error
+// receives the largest collapse error.
+static int simplify_indices(const float *data, int stride, uint32_t *indices, int index_count, int vertex_count,
+                            int target_index_count, float *error) {
+    auto *locked = (bool *) malloc(sizeof(bool) * vertex_count);
+    lock_seams_and_borders(data, stride, indices, index_count, vertex_count, locked);
+
+    auto *quadrics = (Quadric *) calloc((size_t) vertex_count, sizeof(Quadric));
+    for (int t = 0; t < index_count / 3; ++t) {
+        const uint32_t *triangle = indices + t * 3;
+        const float *p0 = data + triangle[0] * stride;
+        double n[3];
+        triangle_cross(p0, data + triangle[1] * stride, data + triangle[2] * stride, n);
+        double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.0) continue;
+        double a = n[0] / length;
+        double b = n[1] / length;
+        double c = n[2] / length;
+        double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+        for (int k = 0; k < 3; ++k) {
+            quadric_add_plane(&quadrics[triangle[k]], a, b, c, d, length * 0.5);
+        }
+    }
+
+    auto *triangle_offset = (int *) malloc(sizeof(int) * (vertex_count + 1));
+    auto *vertex_triangles = (int *) malloc(sizeof(int) * index_count);
+    auto *collapses = (MeshCollapse *) malloc(sizeof(MeshCollapse) * vertex_count);
+    auto *touched = (bool *) malloc(sizeof(bool) * vertex_count);
+
+    int triangle_count = index_count / 3;
+    int target_triangles = target_index_count / 3;
+    double max_cost = 0.0;
+
+    // Every pass collapses the cheapest edges it can without two collapses sharing a neighbourhood, so the
+    // triangle lists built at the start of the pass stay valid for every collapse in it.
+    while (triangle_count > target_triangles) {
+        memset(triangle_offset, 0, sizeof(int) * (vertex_count + 1));
+        for (int i = 0; i < triangle_count * 3; ++i) triangle_offset[indices[i] + 1]++;
+        for (int v = 0; v < vertex_count; ++v) triangle_offset[v + 1] += triangle_offset[v];
+        for (int i = 0; i < triangle_count * 3; ++i) {
+            vertex_triangles[triangle_offset[indices[i]]++] = i / 3;
+        }
+        for (int v = vertex_count; v > 0; --v) triangle_offset[v] = triangle_offset[v - 1];
+        triangle_offset[0] = 0;
+
+        int collapse_count = 0;
+        for (int u = 0; u < vertex_count; ++u) {
+            if (locked[u]) continue;
+            MeshCollapse best = {INFINITY, u, -1};
+            for (int i = triangle_offset[u]; i < triangle_offset[u + 1]; ++i) {
+                const uint32_t *triangle = indices + vertex_triangles[i] * 3;
+                for (int k = 0; k < 3; ++k) {
+                    int v = (int) triangle[k];
+                    if (v == u) continue;
+                    double cost = quadric_error(&quadrics[u], data + v * stride);
+                    if (cost < best.cost) {
+                        best.cost = cost;
+                        best.to = v;
+                    }
+                }
+            }
+            if (best.to >= 0) collapses[collapse_count++] = best;
+        }
+        if (collapse_count == 0) break;
+        qsort(collapses, (size_t) collapse_count, sizeof(MeshCollapse), compare_collapses);
+
+        memset(touched, 0, sizeof(bool) * vertex_count);
+        int removed = 0;
+        for (int c = 0; c < collapse_count && removed < triangle_count - target_triangles; ++c) {
+            int u = collapses[c].from;
+            int v = collapses[c].to;
+            if (touched[u] || touched[v]) continue;
+
+            // triangles around u that do not contain v must not flip
+            bool flips = false;
+            int collapsed_triangles = 0;
+            for (int i = triangle_offset[u]; i < triangle_offset[u + 1] && !flips; ++i) {
+                const uint32_t *triangle = indices + vertex_triangles[i] * 3;
+                if (triangle[0] == (uint32_t) v || triangle[1] == (uint32_t) v || triangle[2] == (uint32_t) v) {
+                    collapsed_triangles++;
+                    continue;
+                }
+                const float *before[3];
+                const float *after[3];
+                for (int k = 0; k < 3; ++k) {
+                    before[k] = data + triangle[k] * stride;
+                    after[k] = triangle[k] == (uint32_t) u ? data + v * stride : before[k];
+                }
+                double n_before[3];
+                double n_after[3];
+                triangle_cross(before[0], before[1], before[2], n_before);
+                triangle_cross(after[0], after[1], after[2], n_after);
+                flips = n_before[0] * n_after[0] + n_before[1] * n_after[1] + n_before[2] * n_after[2] <= 0.0;
+            }
+            if (flips) continue;
+
+            for (int i = triangle_offset[u]; i < triangle_offset[u + 1]; ++i) {
+                uint32_t *triangle = indices + vertex_triangles[i] * 3;
+                for (int k = 0; k < 3; ++k) {
+                    if (triangle[k] == (uint32_t) u) triangle[k] = (uint32_t) v;
+                    touched[triangle[k]] = true;
+                }
+            }
+            touched[u] = true;
+            quadric_add(&quadrics[v], &quadrics[u]);
+            removed += collapsed_triangles;
+            if (collapses[c].cost > max_cost) max_cost = collapses[c].cost;
+        }
+        if (removed == 0) break;
+
+        // drop the triangles that collapsed
+        int written = 0;
+        for (int t = 0; t < triangle_count; ++t) {
+            const uint32_t *triangle = indices + t * 3;
+            if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2]) continue;
+            memmove(indices + written * 3, triangle, sizeof(uint32_t) * 3);
+            written++;
+        }
+        triangle_count = written;
+    }
+
+    *error = (float) sqrt(max_cost);
+
+    free(touched);
+    free(collapses);
+    free(vertex_triangles);
+    free(triangle_offset);
+    free(quadrics);
+    free(locked);
+    return triangle_count * 3;
+}
+
+void mesh_build_lods(SModelData *model, int lod_count) {
+    if (model->index_count == 0) {
+        return;
+    }
+    // the vertices are only read, the index buffer grows
+    assert(!model->mapping.data && model->data);
+    if (lod_count > SMODEL_MAX_LODS) lod_count = SMODEL_MAX_LODS;
+    int stride = model->elems_stride;
+
+    int capacity = model->index_count * 2;
+    auto *all_indices = (uint32_t *) malloc(sizeof(uint32_t) * capacity);
+    int total = model->index_count;
+    for (int i = 0; i < total; ++i) {
+        all_indices[i] = mesh_index(model, i);
+    }
+
+    for (int s = 0; s < model->submodel_count; ++s) {
+        SModelSubmodel *submodel = &model->submodels[s];
+        submodel->lod_count = 1;
+        submodel->lods[0].first_index = submodel->first_index;
+        submodel->lods[0].index_count = submodel->index_count;
+        submodel->lods[0].error = 0.0f;
+
+        const float *vertices = model->data + submodel->first_vertex * stride;
+        auto *work = (uint32_t *) malloc(sizeof(uint32_t) * submodel->index_count);
+        int previous_count = (int) submodel->index_count;
+        float target_ratio = 1.0f;
+
+        for (int lod = 1; lod < lod_count; ++lod) {
+            // every level starts from the full mesh so its error is measured against the full surface
+            for (uint32_t i = 0; i < submodel->index_count; ++i) {
+                work[i] = all_indices[submodel->first_index + i] - submodel->first_vertex;
+            }
+            target_ratio *= MESH_LOD_REDUCTION;
+            int target = (int) (submodel->index_count / 3 * target_ratio) * 3;
+            float error;
+            int count = simplify_indices(vertices, stride, work, (int) submodel->index_count,
+                                         (int) submodel->vertex_count, target, &error);
+            // not worth a level when the locked vertices stop the simplification
+            if (count == 0 || count > previous_count * 9 / 10) {
+                break;
+            }
+
+            if (total + count > capacity) {
+                capacity = (total + count) * 2;
+                all_indices = (uint32_t *) realloc(all_indices, sizeof(uint32_t) * capacity);
+            }
+            for (int i = 0; i < count; ++i) {
+                all_indices[total + i] = work[i] + submodel->first_vertex;
+            }
+
+            SModelLod *level = &submodel->lods[submodel->lod_count++];
+            level->first_index = (uint32_t) total;
+            level->index_count = (uint32_t) count;
+            level->error = error;
+            total += count;
+            previous_count = count;
+        }
+        free(work);
+    }
+
+    // the vertex count did not change so the index size still fits
+    model->indices = realloc(model->indices, (size_t) total * model->index_size);
+    model->index_count = total;
+    for (int i = 0; i < total; ++i) {
+        set_mesh_index(model, i, all_indices[i]);
+    }
+    free(all_indices);
+
+    for (int s = 0; s < model->submodel_count; ++s) {
+        const SModelSubmodel *submodel = &model->submodels[s];
+        for (uint32_t lod = 1; lod < submodel->lod_count; ++lod) {
+            forsyth_optimize(model, (int) submodel->lods[lod].first_index, (int) submodel->lods[lod].index_count,
+                             (int) submodel->first_vertex, (int) submodel->vertex_count);
+        }
+    }
+}
+
+MeshLodStats mesh_lod_stats(const SModelData *model) {
+    MeshLodStats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.lod_count = 1;
+    for (int s = 0; s < model->submodel_count; ++s) {
+        if ((int) model->submodels[s].lod_count > stats.lod_count) stats.lod_count = (int) model->submodels[s].lod_count;
+    }
+
+    for (int lod = 0; lod < stats.lod_count; ++lod) {
+        for (int s = 0; s < model->submodel_count; ++s) {
+            const SModelSubmodel *submodel = &model->submodels[s];
+            if (model->index_count == 0) {
+                stats.triangle_count[lod] += (int) submodel->vertex_count / 3;
+                continue;
+            }
+            uint32_t first_index;
+            uint32_t index_count;
+            smodel_lod_range(submodel, lod, &first_index, &index_count);
+            stats.triangle_count[lod] += (int) index_count / 3;
+            if (submodel->lod_count) {
+                float error = submodel->lods[lod < (int) submodel->lod_count ? lod : submodel->lod_count - 1].error;
+                if (error > stats.error[lod]) stats.error[lod] = error;
+            }
+        }
+    }
+    return stats;
+}
+
+void mesh_cache_lod_selection(SModelData *model) {
+    MeshLodStats stats = mesh_lod_stats(model);
+    model->lod_count = stats.lod_count;
+    memcpy(model->lod_error, stats.error, sizeof(model->lod_error));
+    for (int i = 0; i < 3; ++i) {
+        float min = INFINITY;
+        float max = -INFINITY;
+        for (int s = 0; s < model->submodel_count; ++s) {
+            min = fminf(min, model->submodels[s].aabb_min[i]);
+            max = fmaxf(max, model->submodels[s].aabb_max[i]);
+        }
+        model->center[i] = model->submodel_count ? (min + max) * 0.5f : 0.0f;
+    }
+}
+
+int mesh_select_lod(const SModelData *model, int current_lod, const float model_view_projection[],
+                    float projection_scale) {
+    if (model->lod_count <= 1) {
+        return 0;
+    }
+
+    // clip space w of the center is its distance along the view direction
+    const float *center = model->center;
+    const float *m = model_view_projection;
+    float distance = m[3] * center[0] + m[7] * center[1] + m[11] * center[2] + m[15];
+    if (distance <= 0.0f) {
+        return current_lod;
+    }
+
+    int selected = 0;
+    for (int lod = 1; lod < model->lod_count; ++lod) {
+        float pixels = model->lod_error[lod] * projection_scale / distance;
+        float threshold = MESH_LOD_ERROR_PIXELS * (lod > current_lod ? 1.0f - MESH_LOD_HYSTERESIS : 1.0f + MESH_LOD_HYSTERESIS);
+        if (pixels > threshold) break;
+        selected = lod;
+    }
+    return selected;
+}
+
+static uint16_t quantize_unorm16(float value, float min, float max) {
+    float range = max - min;
+    float normalized = range > 0.0f ? (value - min) / range : 0.0f;
+    if (normalized < 0.0f) normalized = 0.0f;
+    if (normalized > 1.0f) normalized = 1.0f;
+    return (uint16_t) (normalized * 65535.0f + 0.5f);
+}
+
+static float dequantize_unorm16(uint16_t value, float min, float max) {
+    return min + (value / 65535.0f) * (max - min);
+}
+
+// Octahedral normal encoding, the unit sphere is projected on the octahedron |x| + |y| + |z| = 1 and its
+// lower half folded over the upper one. Both results are in [-1, 1].
+static void encode_octahedral(const float normal[3], float *u, float *v) {
+    float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    float x = length > 0.0f ? normal[0] / length : 0.0f;
+    float y = length > 0.0f ? normal[1] / length : 0.0f;
+    float z = length > 0.0f ? normal[2] / length : 1.0f;
+    if (z < 0.0f) {
+        float folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float folded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = folded_x;
+        y = folded_y;
+    }
+    *u = x;
+    *v = y;
+}
+
+static void compute_uv_bounds(const SModelData *model, const SModelSubmodel *submodel, float uv_min[2], float uv_max[2]) {
+    const SModelAttribute *uvs = &model->vertex_format.uvs;
+    for (int i = 0; i < 2; ++i) {
+        uv_min[i] = submodel->vertex_count > 0 && uvs->components ? INFINITY : 0.0f;
+        uv_max[i] = submodel->vertex_count > 0 && uvs->components ? -INFINITY : 0.0f;
+    }
+    if (!uvs->components) {
+        return;
+    }
+    for (uint32_t v = submodel->first_vertex; v < submodel->first_vertex + submodel->vertex_count; ++v) {
+        const float *uv = model->data + v * model->elems_stride + uvs->offset / sizeof(float);
+        for (int i = 0; i < 2; ++i) {
+            if (uv[i] < uv_min[i]) uv_min[i] = uv[i];
+            if (uv[i] > uv_max[i]) uv_max[i] = uv[i];
+        }
+    }
+}
+
+void mesh_quantize(SModelData *model, MeshQuantizeStats *stats) {
+    assert(model->data && !model->vertices);
+    SModelVertexFormat float_format = model->vertex_format;
+    const SModelAttribute *float_uvs = &float_format.uvs;
+    const SModelAttribute *float_normal = &float_format.normal;
+    int stride = model->elems_stride;
+
+    auto *packed = (MeshPackedVertex *) malloc(sizeof(MeshPackedVertex) * model->vertex_number);
+    memset(packed, 0, sizeof(MeshPackedVertex) * model->vertex_number);
+    float max_error_squared = 0.0f;
+
+    for (int s = 0; s < model->submodel_count; ++s) {
+        SModelSubmodel *submodel = &model->submodels[s];
+        smodel_compute_bounds(model, (int) submodel->first_vertex, (int) submodel->vertex_count,
+                              submodel->aabb_min, submodel->aabb_max);
+        compute_uv_bounds(model, submodel, submodel->uv_min, submodel->uv_max);
+
+        for (uint32_t v = submodel->first_vertex; v < submodel->first_vertex + submodel->vertex_count; ++v) {
+            const float *vertex = model->data + v * stride;
+            MeshPackedVertex *out = &packed[v];
+
+            float error_squared = 0.0f;
+            for (int i = 0; i < 3; ++i) {
+                out->position[i] = quantize_unorm16(vertex[i], submodel->aabb_min[i], submodel->aabb_max[i]);
+                float error = dequantize_unorm16(out->position[i], submodel->aabb_min[i], submodel->aabb_max[i]) - vertex[i];
+                error_squared += error * error;
+            }
+            if (error_squared > max_error_squared) max_error_squared = error_squared;
+
+            if (float_uvs->components) {
+                const float *uv = vertex + float_uvs->offset / sizeof(float);
+                for (int i = 0; i < 2; ++i) {
+                    out->uvs[i] = quantize_unorm16(uv[i], submodel->uv_min[i], submodel->uv_max[i]);
+                }
+            }
+
+            if (float_normal->components) {
+                float u;
+                float w;
+                encode_octahedral(vertex + float_normal->offset / sizeof(float), &u, &w);
+                out->normal[0] = quantize_unorm16(u, -1.0f, 1.0f);
+                out->normal[1] = quantize_unorm16(w, -1.0f, 1.0f);
+            }
+        }
+    }
+
+    SModelVertexFormat format;
+    memset(&format, 0, sizeof(format));
+    format.position.type = SMODEL_COMPONENT_UNSIGNED_SHORT;
+    format.position.components = 3;
+    format.position.normalized = 1;
+    format.position.offset = offsetof(MeshPackedVertex, position);
+    if (float_uvs->components) {
+        format.uvs.type = SMODEL_COMPONENT_UNSIGNED_SHORT;
+        format.uvs.components = 2;
+        format.uvs.normalized = 1;
+        format.uvs.offset = offsetof(MeshPackedVertex, uvs);
+    }
+    if (float_normal->components) {
+        format.normal.type = SMODEL_COMPONENT_UNSIGNED_SHORT;
+        format.normal.components = 2;
+        format.normal.normalized = 1;
+        format.normal.encoding = SMODEL_ENCODING_OCTAHEDRAL;
+        format.normal.offset = offsetof(MeshPackedVertex, normal);
+    }
+    format.stride = sizeof(MeshPackedVertex);
+
+    if (stats) {
+        stats->vertex_bytes_before = (int) (float_format.stride * model->vertex_number);
+        stats->vertex_bytes_after = (int) (format.stride * model->vertex_number);
+        stats->max_position_error = sqrtf(max_error_squared);
+    }
+
+    if (model->mapping.data) {
+        // the indices can live in the same mapping, keep a copy before it goes away
+        if (model->index_count) {
+            void *indices = malloc((size_t) model->index_count * model->index_size);
+            memcpy(indices, model->indices, (size_t) model->index_count * model->index_size);
+            model->indices = indices;
+        }
+        unmap_file(&model->mapping);
+    } else {
+        free(model->data);
+    }
+    model->data = nullptr;
+    model->size = 0;
+    model->vertices = packed;
+    model->vertex_format = format;
+}
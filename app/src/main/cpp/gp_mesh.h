@@ -0,0 +1,99 @@
+//
+// Load time mesh processing on SModelData: welding into indexed meshes, vertex cache optimisation and
+// vertex quantization.
+//
+
+#ifndef BLOCKS_GP_MESH_H
+#define BLOCKS_GP_MESH_H
+
+#include "gp_model.h"
+
+// Size of the simulated post transform cache used for the statistics, matches most mobile GPUs
+#define MESH_VERTEX_CACHE_SIZE 32
+
+typedef struct {
+    int vertex_bytes_before;
+    int vertex_bytes_after;
+    int index_bytes;
+    // one vertex shader invocation per vertex without indices, one per cache miss with them
+    int shaded_vertices_before;
+    int shaded_vertices_after;
+} MeshWeldStats;
+
+// Merges vertices with identical position / uvs / normal inside each submodel and turns model into an
+// indexed mesh. Uses 16 bit indices when possible, 32 bit ones only when allow_32bit_indices is set
+// (GL_OES_element_index_uint), otherwise the model is left untouched. Returns false in that case.
+bool mesh_weld(SModelData *model, bool allow_32bit_indices, MeshWeldStats *stats);
+
+uint32_t mesh_index(const SModelData *model, int i);
+
+// Vertex shader invocations needed to draw index_count indices through a FIFO post transform cache
+int mesh_vertex_cache_misses(const SModelData *model, int first_index, int index_count, int cache_size);
+
+typedef struct {
+    // average cache miss ratio, transformed vertices per triangle. 0.5 is the ideal, 3 is no reuse at all
+    float acmr;
+    // average transformed to vertex ratio, 1 is the ideal
+    float atvr;
+} MeshCacheStats;
+
+MeshCacheStats mesh_cache_stats(const SModelData *model, int cache_size);
+
+// Reorders the triangles of every submodel for the post transform cache (Tom Forsyth's linear speed
+// vertex cache optimisation), then renumbers vertices in first use order so fetches walk memory forward.
+void mesh_optimize(SModelData *model);
+
+// Triangle budget of each level relative to the previous one
+#define MESH_LOD_REDUCTION 0.5f
+// A coarser level is picked while its error projects to less than this many pixels
+#define MESH_LOD_ERROR_PIXELS 1.0f
+// Switching to a coarser level needs the error to be this fraction below the threshold, going back to a finer
+// one needs it this fraction above, so a model sitting at the threshold distance does not pop every frame.
+#define MESH_LOD_HYSTERESIS 0.25f
+
+// Builds up to lod_count detail levels per submodel with quadric error edge collapses (Garland / Heckbert).
+// Vertices are only ever collapsed onto a neighbour, never moved, so every level indexes the vertex buffer of
+// the full mesh and only adds indices. Vertices on open borders and on uv / normal seams are kept in place.
+// Runs on the welded and optimized float vertices, before mesh_quantize.
+void mesh_build_lods(SModelData *model, int lod_count);
+
+typedef struct {
+    int lod_count;
+    int triangle_count[SMODEL_MAX_LODS];
+    float error[SMODEL_MAX_LODS];
+} MeshLodStats;
+
+// Triangles and error of each level summed / maxed over the submodels
+MeshLodStats mesh_lod_stats(const SModelData *model);
+
+// Stores what mesh_select_lod needs in the model, once its levels and bounds are final
+void mesh_cache_lod_selection(SModelData *model);
+
+// Detail level to draw the model with. current_lod is the level drawn last frame, projection_scale converts a
+// size at distance 1 to pixels (projection_matrix[5] * viewport_height / 2). Needs mesh_cache_lod_selection.
+int mesh_select_lod(const SModelData *model, int current_lod, const float model_view_projection[],
+                    float projection_scale);
+
+// Packed vertex written by mesh_quantize, 16 bytes instead of 32. Every component is an unsigned
+// normalized short: positions relative to the submodel AABB, uvs relative to the submodel uv range and
+// normals as octahedral coordinates remapped from [-1, 1] to [0, 1]. The unsigned normalized conversion
+// (c / 65535) is the same on every GL ES version, the signed one is not.
+typedef struct {
+    uint16_t position[3];
+    uint16_t padding;
+    uint16_t uvs[2];
+    uint16_t normal[2];
+} MeshPackedVertex;
+
+typedef struct {
+    int vertex_bytes_before;
+    int vertex_bytes_after;
+    // largest distance between a decoded and an original position, in model units
+    float max_position_error;
+} MeshQuantizeStats;
+
+// Replaces the float vertices with MeshPackedVertex and sets the matching vertex_format. The submodel
+// bounds are recomputed from the vertices so every position falls inside its quantization range.
+void mesh_quantize(SModelData *model, MeshQuantizeStats *stats);
+
+#endif //BLOCKS_GP_MESH_H
@@ -5,88 +5,649 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cassert>
+#include <climits>
+#include <cmath>
 
 #import "gp_platform.h"
 #include "gp_model.h"
+#include "gp_float_scan.h"
+#include "gp_jobs.h"
 
-SModelData parse_smodel_file_as_single_model(char* file_data) {
+// Below this many bytes per chunk the threads cost more than they save
+#define SMODEL_PARALLEL_MIN_CHUNK (64 * 1024)
+#define SMODEL_PARALLEL_CHUNKS_PER_THREAD 4
+#define SMODEL_STREAM_BLOCK (16 * 1024)
 
-    char* token = strtok(file_data, " \n");
+static bool token_is(const char* begin, const char* end, char c) {
+    return end - begin == 1 && *begin == c;
+}
 
+static SModelData smodel_text_defaults() {
     SModelData model;
+    memset(&model, 0, sizeof(model));
     model.vertex_number = -1;
     // @note assuming that we always have normals and uvs in the file
     model.elems_per_vertex = 3;
     model.elems_per_normal = 3;
     model.elems_per_uvs = 2;
     model.elems_stride = model.elems_per_vertex + model.elems_per_normal + model.elems_per_uvs;
+    model.has_uvs = true;
+    model.has_normals = true;
+    model.vertex_format = smodel_float_format(&model);
 
     model.data = nullptr;
+    return model;
+}
 
-    int number_elements_read = 0;
+// Handles the ? / % / > header lines, stops in front of the first float or at the end of the buffer.
+static void parse_smodel_headers(const char** cursor, const char* end, SModelData* model) {
+    const char* token = nullptr;
+    const char* token_end = nullptr;
 
-    // @NOTE For now we are assuming that there's a single model per file.
+    while (true) {
+        *cursor = scan_skip_delimiters(*cursor, end);
+        if (*cursor >= end || scan_is_number_start(**cursor)) {
+            return;
+        }
+
+        scan_next_token(cursor, end, &token, &token_end);
 
-    do {
         // ? 2.0 ../assets/model.obj 28539 17
-        if (strcmp(token, "?") == 0) {
-            token = strtok(nullptr, " \n");
-            float export_version = strtof(token, nullptr);
+        if (token_is(token, token_end, '?')) {
+            scan_next_token(cursor, end, &token, &token_end);
+            float export_version = scan_parse_float(token, token_end);
             log_fmt("export version: %f", export_version);
 
-            token = strtok(nullptr, " \n");
-            log_fmt("model name: %s", token);
+            scan_next_token(cursor, end, &token, &token_end);
+            log_fmt("model name: %.*s", (int) (token_end - token), token);
 
-            token = strtok(nullptr, " \n");
-            model.vertex_number = strtol(token, nullptr, 10);
-            log_fmt("total vertices: %d", model.vertex_number);
+            scan_next_token(cursor, end, &token, &token_end);
+            model->vertex_number = (int) scan_parse_int(token, token_end);
+            log_fmt("total vertices: %d", model->vertex_number);
 
-            token = strtok(nullptr, " \n");
-            log_fmt("total submodels: %s", token);
+            scan_next_token(cursor, end, &token, &token_end);
+            log_fmt("total submodels: %d", (int) scan_parse_int(token, token_end));
 
             assert(export_version == 2.0f);
-            model.size = model.vertex_number * model.elems_stride;
-            model.data = (float*) malloc(sizeof(float) * (model.size));
+            model->size = model->vertex_number * model->elems_stride;
+            model->data = (float*) malloc(sizeof(float) * (model->size));
             continue;
         }
 
         // Sub model summary
         // % 36
-        if (strcmp(token, "%") == 0) {
+        if (token_is(token, token_end, '%')) {
             // Skipping
-            token = strtok(nullptr, " \n");
-            //log_fmt("(>) %s", token);
-
+            scan_next_token(cursor, end, &token, &token_end);
             continue;
         }
 
         // Sub model information
         // > submodel_name 1920 1 1 -0.597168 0.084459 0.106442 0.597168 0.38938 0.411364
-        if (strcmp(token, ">") == 0) {
-            // Skipping
-            for (int i = 0; i < 10; ++i) {
-                token = strtok(nullptr, " \n");
-                //log_fmt("(>) %s", token);
-            }
+        if (token_is(token, token_end, '>')) {
+            int index = model->submodel_count++;
+            model->submodels = (SModelSubmodel*) realloc(model->submodels, sizeof(SModelSubmodel) * model->submodel_count);
+            SModelSubmodel* submodel = &model->submodels[index];
+            memset(submodel, 0, sizeof(SModelSubmodel));
+
+            scan_next_token(cursor, end, &token, &token_end);
+            int name_length = (int) (token_end - token);
+            if (name_length >= SMODEL_NAME_LENGTH) name_length = SMODEL_NAME_LENGTH - 1;
+            memcpy(submodel->name, token, (size_t) name_length);
 
+            scan_next_token(cursor, end, &token, &token_end);
+            submodel->vertex_count = (uint32_t) scan_parse_int(token, token_end);
+            submodel->first_vertex = index > 0 ? model->submodels[index - 1].first_vertex + model->submodels[index - 1].vertex_count : 0;
+
+            scan_next_token(cursor, end, &token, &token_end);
+            if (scan_parse_int(token, token_end)) submodel->flags |= SMODEL_FLAG_HAS_UVS;
+            scan_next_token(cursor, end, &token, &token_end);
+            if (scan_parse_int(token, token_end)) submodel->flags |= SMODEL_FLAG_HAS_NORMALS;
+
+            for (int i = 0; i < 3; ++i) {
+                scan_next_token(cursor, end, &token, &token_end);
+                submodel->aabb_min[i] = scan_parse_float(token, token_end);
+            }
+            for (int i = 0; i < 3; ++i) {
+                scan_next_token(cursor, end, &token, &token_end);
+                submodel->aabb_max[i] = scan_parse_float(token, token_end);
+            }
             continue;
         }
 
-        // @NOTE this could be faster, we know we are inside a float section without looping
+        log_fmt("unexpected token: %.*s", (int) (token_end - token), token);
+    }
+}
+
+// Parses from cursor to the end of the buffer, continuing after number_elements_read floats.
+// Returns the number of floats in model->data afterwards.
+static int parse_smodel_body(const char* cursor, const char* end, SModelData* model, int number_elements_read = 0) {
+
+    while (true) {
+        parse_smodel_headers(&cursor, end, model);
+        if (cursor >= end) {
+            break;
+        }
 
         // ensure we found the previous header line to allocate the space
-        assert(model.data);
+        assert(model->data);
+
+        // Float section, parse every number until the next header line
+        int parsed = scan_parse_floats(&cursor, end, model->data + number_elements_read,
+                                       model->size - number_elements_read);
+        number_elements_read += parsed;
+        if (parsed == 0) {
+            log_fmt("parse_smodel_body: more floats than the %d announced in the header", model->size);
+            break;
+        }
+    }
+
+    return number_elements_read;
+}
+
+// Makes sure the submodel table of a text model covers exactly the parsed vertices
+static void finish_smodel_submodels(SModelData* model) {
+    uint32_t covered = 0;
+    for (int i = 0; i < model->submodel_count; ++i) {
+        covered += model->submodels[i].vertex_count;
+    }
+    if (model->submodel_count > 0 && covered == (uint32_t) model->vertex_number) {
+        return;
+    }
+
+    if (model->submodel_count > 0) {
+        log_fmt("submodels cover %d of %d vertices, using a single submodel", covered, model->vertex_number);
+    }
+    model->submodel_count = 1;
+    model->submodels = (SModelSubmodel*) realloc(model->submodels, sizeof(SModelSubmodel));
+    SModelSubmodel* submodel = &model->submodels[0];
+    memset(submodel, 0, sizeof(SModelSubmodel));
+    memcpy(submodel->name, "default", sizeof("default"));
+    submodel->vertex_count = (uint32_t) model->vertex_number;
+    submodel->flags = (model->has_uvs ? SMODEL_FLAG_HAS_UVS : 0) | (model->has_normals ? SMODEL_FLAG_HAS_NORMALS : 0);
+    // the bounds are read from the float vertices
+    if (model->data) {
+        smodel_compute_bounds(model, 0, model->vertex_number, submodel->aabb_min, submodel->aabb_max);
+    }
+}
+
+SModelVertexFormat smodel_float_format(const SModelData* model) {
+    SModelVertexFormat format;
+    memset(&format, 0, sizeof(format));
+    uint32_t offset = 0;
+
+    format.position.type = SMODEL_COMPONENT_FLOAT;
+    format.position.components = (uint8_t) model->elems_per_vertex;
+    format.position.offset = offset;
+    offset += sizeof(float) * model->elems_per_vertex;
+
+    if (model->has_uvs) {
+        format.uvs.type = SMODEL_COMPONENT_FLOAT;
+        format.uvs.components = (uint8_t) model->elems_per_uvs;
+        format.uvs.offset = offset;
+        offset += sizeof(float) * model->elems_per_uvs;
+    }
+
+    if (model->has_normals) {
+        format.normal.type = SMODEL_COMPONENT_FLOAT;
+        format.normal.components = (uint8_t) model->elems_per_normal;
+        format.normal.offset = offset;
+    }
 
-        float f = strtof(token, nullptr);
-        model.data[number_elements_read] = f;
-        number_elements_read += 1;
+    format.stride = sizeof(float) * model->elems_stride;
+    return format;
+}
 
-    } while((token = strtok(nullptr, " \n")));
+const void* smodel_vertex_data(const SModelData* model) {
+    return model->vertices ? model->vertices : model->data;
+}
+
+size_t smodel_vertex_data_size(const SModelData* model) {
+    return (size_t) model->vertex_number * model->vertex_format.stride;
+}
+
+static void attribute_decode_transform(const SModelAttribute* attribute, int components, const float min[],
+                                       const float max[], float offset[], float scale[]) {
+    for (int i = 0; i < components; ++i) {
+        // normalized attributes are in [0, 1] across the range
+        bool quantized = attribute->normalized && attribute->type != SMODEL_COMPONENT_FLOAT;
+        offset[i] = quantized ? min[i] : 0.0f;
+        scale[i] = quantized ? max[i] - min[i] : 1.0f;
+    }
+}
+
+void smodel_decode_transform(const SModelData* model, const SModelSubmodel* submodel,
+                             float position_offset[3], float position_scale[3],
+                             float uv_offset[2], float uv_scale[2]) {
+    attribute_decode_transform(&model->vertex_format.position, 3, submodel->aabb_min, submodel->aabb_max,
+                               position_offset, position_scale);
+    attribute_decode_transform(&model->vertex_format.uvs, 2, submodel->uv_min, submodel->uv_max,
+                               uv_offset, uv_scale);
+}
+
+void smodel_lod_range(const SModelSubmodel* submodel, int lod, uint32_t* first_index, uint32_t* index_count) {
+    if (submodel->lod_count == 0) {
+        *first_index = submodel->first_index;
+        *index_count = submodel->index_count;
+        return;
+    }
+    const SModelLod* level = &submodel->lods[lod < (int) submodel->lod_count ? lod : submodel->lod_count - 1];
+    *first_index = level->first_index;
+    *index_count = level->index_count;
+}
+
+void smodel_compute_bounds(const SModelData* model, int first_vertex, int vertex_count, float aabb_min[3], float aabb_max[3]) {
+    for (int i = 0; i < 3; ++i) {
+        aabb_min[i] = vertex_count > 0 ? INFINITY : 0.0f;
+        aabb_max[i] = vertex_count > 0 ? -INFINITY : 0.0f;
+    }
+    for (int v = first_vertex; v < first_vertex + vertex_count; ++v) {
+        const float* position = model->data + v * model->elems_stride;
+        for (int i = 0; i < 3; ++i) {
+            if (position[i] < aabb_min[i]) aabb_min[i] = position[i];
+            if (position[i] > aabb_max[i]) aabb_max[i] = position[i];
+        }
+    }
+}
+
+SModelData parse_smodel_text(const char* text, size_t length) {
+    SModelData model = smodel_text_defaults();
+
+    // @NOTE For now we are assuming that there's a single model per file.
+    int number_elements_read = parse_smodel_body(text, text + length, &model);
 
     log_fmt("Number of elements read: %d -> should have: %d\n", number_elements_read, (model.elems_stride * model.vertex_number));
-    free(file_data);
 
     assert(model.vertex_number > 0);
     assert(model.data);
+    finish_smodel_submodels(&model);
+    return model;
+}
+
+SModelData parse_smodel_stream(FileReader* reader) {
+    SModelData model = smodel_text_defaults();
+    int number_elements_read = 0;
+
+    // Peak memory is model.data plus this block, lines are never split between two parse calls
+    auto* block = (char*) malloc(SMODEL_STREAM_BLOCK);
+    size_t kept = 0;
+    bool reached_end = false;
+
+    bool failed = false;
+    while (!reached_end) {
+        int read = reader->read(reader->handle, block + kept, (int) (SMODEL_STREAM_BLOCK - kept));
+        if (read < 0) {
+            log_str("parse_smodel_stream: read error");
+            failed = true;
+            break;
+        }
+        size_t filled = kept + read;
+        reached_end = read == 0;
+
+        const char* parse_end = block + filled;
+        if (!reached_end) {
+            // stop after the last complete line, the rest waits for the next block
+            const char* last_line_end = block + filled;
+            while (last_line_end > block && last_line_end[-1] != '\n') last_line_end--;
+            if (last_line_end == block) {
+                log_fmt("parse_smodel_stream: line longer than %d bytes", SMODEL_STREAM_BLOCK);
+                failed = true;
+                break;
+            }
+            parse_end = last_line_end;
+        }
+
+        number_elements_read = parse_smodel_body(block, parse_end, &model, number_elements_read);
+
+        kept = (size_t) (block + filled - parse_end);
+        memmove(block, parse_end, kept);
+    }
+
+    free(block);
+
+    log_fmt("Number of elements read: %d -> should have: %d\n", number_elements_read, (model.elems_stride * model.vertex_number));
+
+    if (failed || model.vertex_number <= 0 || !model.data || number_elements_read < model.size) {
+        log_str("parse_smodel_stream: the file is cut off or unreadable");
+        free_smodel(&model);
+        memset(&model, 0, sizeof(SModelData));
+        return model;
+    }
+    finish_smodel_submodels(&model);
+    return model;
+}
+
+typedef struct {
+    const char* begin;
+    const char* end;
+    int first_element;
+    int element_count;
+    int parsed;
+} SModelParseChunk;
+
+typedef struct {
+    SModelParseChunk* chunks;
+    float* data;
+} SModelParseJob;
+
+static void count_chunk_job(void* user, int index) {
+    auto* job = (SModelParseJob*) user;
+    SModelParseChunk* chunk = &job->chunks[index];
+    chunk->element_count = (int) scan_count_tokens(chunk->begin, chunk->end);
+}
+
+static void parse_chunk_job(void* user, int index) {
+    auto* job = (SModelParseJob*) user;
+    SModelParseChunk* chunk = &job->chunks[index];
+    const char* cursor = chunk->begin;
+    chunk->parsed = scan_parse_floats(&cursor, chunk->end, job->data + chunk->first_element, chunk->element_count);
+}
+
+SModelData parse_smodel_text_parallel(const char* text, size_t length) {
+    const char* end = text + length;
+    const char* body = text;
+
+    SModelData model = smodel_text_defaults();
+    parse_smodel_headers(&body, end, &model);
+    assert(model.vertex_number > 0);
+    assert(model.data);
+
+    size_t body_size = (size_t) (end - body);
+    int chunk_count = (jobs_worker_count() + 1) * SMODEL_PARALLEL_CHUNKS_PER_THREAD;
+    if ((size_t) chunk_count > body_size / SMODEL_PARALLEL_MIN_CHUNK) {
+        chunk_count = (int) (body_size / SMODEL_PARALLEL_MIN_CHUNK);
+    }
+    if (jobs_worker_count() == 0 || chunk_count < 2) {
+        int number_elements_read = parse_smodel_body(body, end, &model);
+        log_fmt("Number of elements read: %d -> should have: %d\n", number_elements_read, model.size);
+        finish_smodel_submodels(&model);
+        return model;
+    }
+
+    // Line aligned chunks, a float never straddles two of them
+    auto* chunks = (SModelParseChunk*) malloc(sizeof(SModelParseChunk) * chunk_count);
+    const char* chunk_begin = body;
+    for (int i = 0; i < chunk_count; ++i) {
+        const char* chunk_end = end;
+        if (i < chunk_count - 1) {
+            chunk_end = body + body_size * (i + 1) / chunk_count;
+            if (chunk_end < chunk_begin) chunk_end = chunk_begin;
+            const char* new_line = (const char*) memchr(chunk_end, '\n', (size_t) (end - chunk_end));
+            chunk_end = new_line ? new_line + 1 : end;
+        }
+        chunks[i].begin = chunk_begin;
+        chunks[i].end = chunk_end;
+        chunks[i].parsed = 0;
+        chunk_begin = chunk_end;
+    }
+
+    SModelParseJob job;
+    job.chunks = chunks;
+    job.data = model.data;
+
+    // First pass counts the floats in each chunk so every chunk knows where its output starts
+    jobs_parallel_for(chunk_count, count_chunk_job, &job);
+    int total = 0;
+    for (int i = 0; i < chunk_count; ++i) {
+        chunks[i].first_element = total;
+        total += chunks[i].element_count;
+    }
+
+    bool valid = total == model.size;
+    if (valid) {
+        jobs_parallel_for(chunk_count, parse_chunk_job, &job);
+        for (int i = 0; i < chunk_count; ++i) {
+            // a header line inside the body stops scan_parse_floats early
+            valid = valid && chunks[i].parsed == chunks[i].element_count;
+        }
+    }
+
+    if (!valid) {
+        log_fmt("parse_smodel_text_parallel: body is not a flat list of %d floats, parsing serially", model.size);
+        parse_smodel_body(body, end, &model);
+    }
+
+    log_fmt("Number of elements read: %d -> should have: %d chunks: %d\n", total, model.size, chunk_count);
+    free(chunks);
+    finish_smodel_submodels(&model);
+    return model;
+}
+
+SModelData parse_smodel_file_as_single_model(char* file_data) {
+    SModelData model = parse_smodel_text(file_data, strlen(file_data));
+    free(file_data);
+    return model;
+}
+
+// Attributes GL reads must lie within a vertex, absent ones always do
+static bool smodel_attribute_fits(const SModelAttribute* attribute, uint32_t stride) {
+    // by SModelComponentType
+    static const uint32_t component_sizes[] = {4, 2, 2, 1};
+    if (attribute->components == 0) {
+        return true;
+    }
+    if (attribute->components > 4 || attribute->type > SMODEL_COMPONENT_BYTE ||
+        attribute->encoding > SMODEL_ENCODING_OCTAHEDRAL) {
+        return false;
+    }
+    return (uint64_t) attribute->offset + attribute->components * component_sizes[attribute->type] <= stride;
+}
+
+bool parse_smodel_binary(const void* file_data, size_t file_size, SModelData* model) {
+    if (file_size < sizeof(SModelBinaryHeader)) {
+        log_fmt("parse_smodel_binary: file too small %d", (int) file_size);
+        return false;
+    }
+
+    const auto* bytes = (const uint8_t*) file_data;
+    const auto* header = (const SModelBinaryHeader*) file_data;
+
+    if (header->magic != SMODEL_BINARY_MAGIC || header->version != SMODEL_BINARY_VERSION) {
+        log_fmt("parse_smodel_binary: unexpected magic 0x%x or version %d", header->magic, header->version);
+        return false;
+    }
+
+    // 64 bit sums, size_t wraps on the 32 bit ABIs
+    const SModelVertexFormat* format = &header->vertex_format;
+    uint64_t vertex_data_size = (uint64_t) header->vertex_number * format->stride;
+    uint64_t table_size = (uint64_t) header->submodel_count * sizeof(SModelSubmodel);
+    uint64_t index_data_size = (uint64_t) header->index_count * header->index_size;
+    uint32_t elems_stride = 3 + ((header->flags & SMODEL_FLAG_HAS_UVS) ? 2 : 0) +
+                            ((header->flags & SMODEL_FLAG_HAS_NORMALS) ? 3 : 0);
+    if (header->header_size != sizeof(SModelBinaryHeader) ||
+        format->stride == 0 || format->position.components == 0 ||
+        !smodel_attribute_fits(&format->position, format->stride) ||
+        !smodel_attribute_fits(&format->uvs, format->stride) ||
+        !smodel_attribute_fits(&format->normal, format->stride) ||
+        header->vertex_number > INT_MAX || header->index_count > INT_MAX || header->submodel_count > INT_MAX ||
+        header->elems_stride != elems_stride ||
+        (format->position.type == SMODEL_COMPONENT_FLOAT && format->stride != sizeof(float) * elems_stride) ||
+        header->vertex_data_size != vertex_data_size ||
+        header->vertex_data_offset % SMODEL_BINARY_ALIGNMENT != 0 ||
+        header->submodel_table_offset + table_size > file_size ||
+        header->vertex_data_offset + vertex_data_size > file_size ||
+        (header->index_count && header->index_size != 2 && header->index_size != 4) ||
+        (header->index_count && header->index_data_offset % SMODEL_BINARY_ALIGNMENT != 0) ||
+        header->index_data_offset + index_data_size > file_size) {
+        log_fmt("parse_smodel_binary: corrupted header");
+        return false;
+    }
+
+    memset(model, 0, sizeof(SModelData));
+    model->has_uvs = (header->flags & SMODEL_FLAG_HAS_UVS) != 0;
+    model->has_normals = (header->flags & SMODEL_FLAG_HAS_NORMALS) != 0;
+    model->elems_per_vertex = 3;
+    model->elems_per_uvs = model->has_uvs ? 2 : 0;
+    model->elems_per_normal = model->has_normals ? 3 : 0;
+    model->elems_stride = header->elems_stride;
+    model->vertex_number = header->vertex_number;
+    model->vertex_format = *format;
+
+    // No copy, the vertices are used straight from the file
+    void* vertices = (void*) (bytes + header->vertex_data_offset);
+    if (format->position.type == SMODEL_COMPONENT_FLOAT) {
+        model->data = (float*) vertices;
+        model->size = model->vertex_number * model->elems_stride;
+    } else {
+        model->vertices = vertices;
+    }
+    if (header->index_count) {
+        model->index_count = header->index_count;
+        model->index_size = header->index_size;
+        model->indices = (void*) (bytes + header->index_data_offset);
+        for (int i = 0; i < model->index_count; ++i) {
+            uint32_t index = model->index_size == 2 ? ((const uint16_t*) model->indices)[i]
+                                                    : ((const uint32_t*) model->indices)[i];
+            if (index >= header->vertex_number) {
+                log_fmt("parse_smodel_binary: index %d is %u of %u vertices", i, index, header->vertex_number);
+                return false;
+            }
+        }
+    }
+
+    model->submodel_count = header->submodel_count;
+    model->submodels = (SModelSubmodel*) malloc((size_t) table_size);
+    memcpy(model->submodels, bytes + header->submodel_table_offset, (size_t) table_size);
+    // the writer always covers every vertex, quantized vertices have no float data to fall back on
+    uint64_t covered = 0;
+    for (int i = 0; i < model->submodel_count; ++i) {
+        covered += model->submodels[i].vertex_count;
+    }
+    if (model->submodel_count == 0 || covered != header->vertex_number) {
+        log_fmt("parse_smodel_binary: submodels cover %d of %u vertices", (int) covered, header->vertex_number);
+        free(model->submodels);
+        model->submodels = nullptr;
+        return false;
+    }
+    for (int i = 0; i < model->submodel_count; ++i) {
+        const SModelSubmodel* submodel = &model->submodels[i];
+        bool valid = (uint64_t) submodel->first_vertex + submodel->vertex_count <= header->vertex_number &&
+                     (uint64_t) submodel->first_index + submodel->index_count <= header->index_count &&
+                     submodel->lod_count <= SMODEL_MAX_LODS;
+        for (uint32_t lod = 0; valid && lod < submodel->lod_count; ++lod) {
+            valid = (uint64_t) submodel->lods[lod].first_index + submodel->lods[lod].index_count <= header->index_count;
+        }
+        if (!valid) {
+            log_fmt("parse_smodel_binary: %s is outside the vertices or indices", submodel->name);
+            free(model->submodels);
+            model->submodels = nullptr;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static size_t align_binary_offset(size_t offset) {
+    return (offset + SMODEL_BINARY_ALIGNMENT - 1) / SMODEL_BINARY_ALIGNMENT * SMODEL_BINARY_ALIGNMENT;
+}
+
+static void write_binary_padding(FILE* file, size_t from, size_t to) {
+    const char padding[SMODEL_BINARY_ALIGNMENT] = {0};
+    assert(to >= from && to - from < SMODEL_BINARY_ALIGNMENT);
+    fwrite(padding, 1, to - from, file);
+}
+
+bool write_smodel_binary(const SModelData* model, const char* file_name) {
+    SModelBinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SMODEL_BINARY_MAGIC;
+    header.version = SMODEL_BINARY_VERSION;
+    header.header_size = sizeof(SModelBinaryHeader);
+    header.flags = (model->has_uvs ? SMODEL_FLAG_HAS_UVS : 0) | (model->has_normals ? SMODEL_FLAG_HAS_NORMALS : 0);
+    header.vertex_number = (uint32_t) model->vertex_number;
+    header.elems_stride = (uint32_t) model->elems_stride;
+    header.submodel_count = (uint32_t) model->submodel_count;
+    header.submodel_table_offset = sizeof(SModelBinaryHeader);
+
+    size_t table_end = header.submodel_table_offset + model->submodel_count * sizeof(SModelSubmodel);
+    header.vertex_data_offset = (uint32_t) align_binary_offset(table_end);
+    header.vertex_format = model->vertex_format;
+    header.vertex_data_size = (uint32_t) (model->vertex_number * model->vertex_format.stride);
+
+    size_t vertex_end = header.vertex_data_offset + header.vertex_data_size;
+    header.index_count = (uint32_t) model->index_count;
+    header.index_size = model->index_count ? (uint32_t) model->index_size : 0;
+    header.index_data_offset = (uint32_t) align_binary_offset(vertex_end);
+
+    FILE* file = fopen(file_name, "wb");
+    if (!file) {
+        log_fmt("write_smodel_binary: could not open %s", file_name);
+        return false;
+    }
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(model->submodels, sizeof(SModelSubmodel), (size_t) model->submodel_count, file);
+    write_binary_padding(file, table_end, header.vertex_data_offset);
+    fwrite(smodel_vertex_data(model), 1, header.vertex_data_size, file);
+    if (model->index_count) {
+        write_binary_padding(file, vertex_end, header.index_data_offset);
+        fwrite(model->indices, (size_t) model->index_size, (size_t) model->index_count, file);
+    }
+
+    bool written = ferror(file) == 0;
+    fclose(file);
+    return written;
+}
+
+SModelData load_smodel(const char* file_name, SModelTextMode text_mode) {
+    char binary_name[256];
+    snprintf(binary_name, sizeof(binary_name), "%s%s", file_name, SMODEL_BINARY_EXTENSION);
+
+    FileView view;
+    if (map_file(binary_name, &view)) {
+        SModelData model;
+        if (parse_smodel_binary(view.data, view.size, &model)) {
+            log_fmt("load_smodel: mapped %s vertices: %d indices: %d", binary_name, model.vertex_number, model.index_count);
+            model.mapping = view;
+            return model;
+        }
+        unmap_file(&view);
+    }
+
+    log_fmt("load_smodel: falling back to text %s", file_name);
+    SModelData model;
+    memset(&model, 0, sizeof(SModelData));
+    if (text_mode == SMODEL_TEXT_PARALLEL) {
+        char* text = read_entire_file(file_name, 'r');
+        if (!text) {
+            log_fmt("load_smodel: could not open %s", file_name);
+            return model;
+        }
+        model = parse_smodel_text_parallel(text, strlen(text));
+        free(text);
+        return model;
+    }
+
+    FileReader reader;
+    if (!open_file_reader(file_name, &reader)) {
+        log_fmt("load_smodel: could not open %s", file_name);
+        return model;
+    }
+    model = parse_smodel_stream(&reader);
+    reader.close(reader.handle);
     return model;
-}
\ No newline at end of file
+}
+
+void smodel_release_vertices(SModelData* model) {
+    if (model->mapping.data) {
+        // vertices and indices live in the mapping
+        unmap_file(&model->mapping);
+        memset(&model->mapping, 0, sizeof(FileView));
+    } else {
+        free(model->data);
+        free(model->vertices);
+        free(model->indices);
+    }
+    model->data = nullptr;
+    model->vertices = nullptr;
+    model->indices = nullptr;
+}
+
+void free_smodel(SModelData* model) {
+    smodel_release_vertices(model);
+    model->index_count = 0;
+    free(model->submodels);
+    model->submodels = nullptr;
+    model->submodel_count = 0;
+}
@@ -5,6 +5,75 @@
 #ifndef BLOCKS_GP_MODEL_H
 #define BLOCKS_GP_MODEL_H
 
+#include <cstdint>
+
+#include "gp_platform.h"
+
+#define SMODEL_NAME_LENGTH 32
+
+// Detail levels per submodel, level 0 is the full mesh
+#define SMODEL_MAX_LODS 4
+
+#define SMODEL_FLAG_HAS_UVS (1 << 0)
+#define SMODEL_FLAG_HAS_NORMALS (1 << 1)
+
+// A simplified version of a submodel, it indexes the same vertices as the full mesh (see mesh_build_lods)
+typedef struct {
+    uint32_t first_index;
+    uint32_t index_count;
+    // largest distance between the simplified and the full surface, in model units
+    float error;
+} SModelLod;
+
+// A part of the model, its vertices are [first_vertex, first_vertex + vertex_count) of SModelData::data.
+// For indexed models its triangles are [first_index, first_index + index_count) of SModelData::indices.
+typedef struct {
+    char name[SMODEL_NAME_LENGTH];
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+    uint32_t first_index;
+    uint32_t index_count;
+    uint32_t flags;
+    float aabb_min[3];
+    float aabb_max[3];
+    // uv range, quantized uvs are stored relative to it
+    float uv_min[2];
+    float uv_max[2];
+    // 0 until mesh_build_lods runs, lods[0] is [first_index, first_index + index_count) then
+    uint32_t lod_count;
+    SModelLod lods[SMODEL_MAX_LODS];
+} SModelSubmodel;
+
+// Component types of SModelAttribute, mirror the GL types render_model hands to glVertexAttribPointer
+typedef enum {
+    SMODEL_COMPONENT_FLOAT,
+    SMODEL_COMPONENT_SHORT,
+    SMODEL_COMPONENT_UNSIGNED_SHORT,
+    SMODEL_COMPONENT_BYTE
+} SModelComponentType;
+
+typedef enum {
+    SMODEL_ENCODING_PLAIN,
+    // two components, unit vector folded onto an octahedron and unfolded in the shader
+    SMODEL_ENCODING_OCTAHEDRAL
+} SModelAttributeEncoding;
+
+// components == 0 means the attribute is not present
+typedef struct {
+    uint8_t type;
+    uint8_t components;
+    uint8_t normalized;
+    uint8_t encoding;
+    uint32_t offset;
+} SModelAttribute;
+
+typedef struct {
+    SModelAttribute position;
+    SModelAttribute uvs;
+    SModelAttribute normal;
+    uint32_t stride;
+} SModelVertexFormat;
+
 typedef struct {
     bool has_normals;
     int elems_per_normal;
@@ -16,8 +85,137 @@ typedef struct {
     int size;
     float* data;
 
+    // How the vertices are laid out for GL. Plain floats from data until mesh_quantize packs them into
+    // vertices, data is released then.
+    SModelVertexFormat vertex_format;
+    void* vertices;
+
+    // Indexed models (see mesh_weld), index_count == 0 means data is drawn as plain triangles
+    int index_count;
+    // 2 or 4 bytes per index
+    int index_size;
+    void* indices;
+
+    // Always at least one, a file without > lines gets a single submodel covering every vertex
+    int submodel_count;
+    SModelSubmodel* submodels;
+
+    // What mesh_select_lod reads on every draw, set once by mesh_cache_lod_selection after the levels are built:
+    // the level count, the largest error of each level over the submodels and the center of the model bounds.
+    // lod_count 0 until then, always the full mesh.
+    int lod_count;
+    float lod_error[SMODEL_MAX_LODS];
+    float center[3];
+
+    // Set when data points inside a mapped .smodelb file instead of a malloc'ed block
+    FileView mapping;
+
+    // GL buffer names once the render thread uploaded the vertices and indices (see game.cpp), 0 while they are
+    // drawn from the client side arrays
+    uint32_t vertex_buffer;
+    uint32_t index_buffer;
+    // GL_OES_vertex_array_object (or ES 3) object recording the attribute setup for vertex_array_program, 0
+    // without one
+    uint32_t vertex_array;
+    uint32_t vertex_array_program;
+    // batch_instances copies of the vertices and indices for drawing that many instances at once without instanced
+    // arrays (see game.cpp), 0 without them. Copy k of every vertex has instance index k in batch_instance_buffer,
+    // the copies of an index range start at first_index * batch_instances in batch_index_buffer.
+    uint32_t batch_vertex_buffer;
+    uint32_t batch_instance_buffer;
+    uint32_t batch_index_buffer;
+    int batch_index_size;
+    int batch_instances;
 } SModelData;
 
+/**
+ * Binary .smodelb container
+ *
+ * [SModelBinaryHeader][SModelSubmodel * submodel_count][padding][vertex data][padding][index data]
+ *
+ * The vertex data starts at a SMODEL_BINARY_ALIGNMENT aligned offset and is laid out as described by
+ * vertex_format (floats like SModelData::data or quantized, see mesh_quantize) so it can be handed to GL
+ * straight from the mapping.
+ * Models written already welded and optimized (see gp_mesh.h) carry their index buffer too, index_count
+ * is 0 otherwise. All fields are little endian.
+ */
+
+#define SMODEL_BINARY_MAGIC 0x42444d53 // "SMDB"
+#define SMODEL_BINARY_VERSION 6
+#define SMODEL_BINARY_ALIGNMENT 16
+#define SMODEL_BINARY_EXTENSION "b"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t flags;
+    uint32_t vertex_number;
+    uint32_t elems_stride;
+    uint32_t submodel_count;
+    uint32_t submodel_table_offset;
+    uint32_t vertex_data_offset;
+    uint32_t vertex_data_size;
+    uint32_t index_count;
+    uint32_t index_size;
+    uint32_t index_data_offset;
+    uint32_t reserved[3];
+    SModelVertexFormat vertex_format;
+} SModelBinaryHeader;
+
+SModelData parse_smodel_text(const char* text, size_t length);
+
+// Same result as parse_smodel_text, the floats are parsed in line aligned chunks on the jobs pool.
+SModelData parse_smodel_text_parallel(const char* text, size_t length);
+
+// Parses a null terminated .smodel file and frees file_data.
 SModelData parse_smodel_file_as_single_model(char* file_data);
 
+// Pulls the file through reader in small blocks, never holding more than one block of text. An empty model (no
+// submodels) when reading fails or the file has fewer values than its vertex count asks for.
+SModelData parse_smodel_stream(FileReader* reader);
+
+bool parse_smodel_binary(const void* file_data, size_t file_size, SModelData* model);
+
+// Host side, used by tools/smodel_convert.
+bool write_smodel_binary(const SModelData* model, const char* file_name);
+
+typedef enum {
+    // lowest memory, the text is streamed through a small block
+    SMODEL_TEXT_STREAM,
+    // the whole text is read and parsed on the jobs pool. Opt-in only, the game loads several models at once on
+    // that pool already and no multi core device measured it faster than the stream. Compare with
+    // tools/bench_smodel_parse before using it.
+    SMODEL_TEXT_PARALLEL
+} SModelTextMode;
+
+// Loads "<file_name>b" when it exists, otherwise parses the text file. An empty model (no submodels) when neither
+// can be read.
+SModelData load_smodel(const char* file_name, SModelTextMode text_mode = SMODEL_TEXT_STREAM);
+
+// Float layout of SModelData::data (position, uvs, normal)
+SModelVertexFormat smodel_float_format(const SModelData* model);
+
+// What GL reads the vertices from, the packed vertices or the floats.
+const void* smodel_vertex_data(const SModelData* model);
+
+// Size of smodel_vertex_data in bytes
+size_t smodel_vertex_data_size(const SModelData* model);
+
+// Maps the attributes of a submodel back to model space: value = offset + attribute * scale.
+// Identity for float attributes.
+void smodel_decode_transform(const SModelData* model, const SModelSubmodel* submodel,
+                             float position_offset[3], float position_scale[3],
+                             float uv_offset[2], float uv_scale[2]);
+
+// Index range of a detail level, levels past the last one the submodel has use its coarsest one.
+void smodel_lod_range(const SModelSubmodel* submodel, int lod, uint32_t* first_index, uint32_t* index_count);
+
+void smodel_compute_bounds(const SModelData* model, int first_vertex, int vertex_count, float aabb_min[3], float aabb_max[3]);
+
+void free_smodel(SModelData* model);
+
+// Releases the vertices and indices once they live in GL buffers, the submodels stay.
+void smodel_release_vertices(SModelData* model);
+
 #endif //BLOCKS_GP_MODEL_H
@@ -0,0 +1,82 @@
+//
+// Asset pack format, every asset of the game in one file that is mapped once (see vfs_mount in gp_platform.h).
+//
+// [PackHeader][PackEntry * table_size][names][padding][entry data]...
+//
+// The entry table is an open addressing hash table indexed by pack_hash_name(name) & (table_size - 1) with
+// linear probing, empty slots have name_length 0. Entry data starts at PACK_ALIGNMENT aligned offsets so
+// stored entries can be used in place (.smodelb vertex data, ...). Compressed entries are zlib streams.
+// All fields are little endian.
+//
+
+#ifndef BLOCKS_GP_PACK_H
+#define BLOCKS_GP_PACK_H
+
+#include <cstdint>
+#include <cstring>
+
+#define PACK_MAGIC 0x4b415047 // "GPAK"
+#define PACK_VERSION 1
+#define PACK_ALIGNMENT 16
+#define PACK_EXTENSION ".pak"
+
+#define PACK_ENTRY_ZLIB (1 << 0)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_count;
+    // power of two
+    uint32_t table_size;
+    uint32_t table_offset;
+    uint32_t names_offset;
+    uint32_t reserved[2];
+} PackHeader;
+
+typedef struct {
+    uint32_t name_hash;
+    // into the names block, names are not null terminated
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t flags;
+    uint32_t offset;
+    // bytes in the pack
+    uint32_t size;
+    // bytes once decompressed, same as size for stored entries
+    uint32_t uncompressed_size;
+    uint32_t reserved;
+} PackEntry;
+
+// FNV-1a
+static inline uint32_t pack_hash_name(const char *name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ (uint8_t) name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Entry called name in the mapped pack at data, nullptr when there is none. Probes at most table_size slots.
+static inline const PackEntry *pack_find(const void *data, const char *name) {
+    const auto *header = (const PackHeader *) data;
+    const auto *entries = (const PackEntry *) ((const uint8_t *) data + header->table_offset);
+    const char *names = (const char *) data + header->names_offset;
+    size_t length = strlen(name);
+    uint32_t hash = pack_hash_name(name, length);
+    uint32_t mask = header->table_size - 1;
+
+    uint32_t slot = hash & mask;
+    for (uint32_t probe = 0; probe < header->table_size; ++probe, slot = (slot + 1) & mask) {
+        const PackEntry *entry = &entries[slot];
+        if (entry->name_length == 0) {
+            return nullptr;
+        }
+        if (entry->name_hash == hash && entry->name_length == length &&
+            memcmp(names + entry->name_offset, name, length) == 0) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+#endif //BLOCKS_GP_PACK_H
@@ -0,0 +1,337 @@
+//
+// Pixel conversion kernels, see gp_pixels.h
+//
+
+#include <cstring>
+
+#include "gp_pixels.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PIXELS_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PIXELS_SSE2
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define PIXELS_SSSE3
+#endif
+#endif
+
+const char *pixels_simd_name() {
+#if defined(PIXELS_NEON)
+    return "NEON";
+#elif defined(PIXELS_SSSE3)
+    return "SSSE3";
+#elif defined(PIXELS_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+// c * a / 255 rounded, exact for every pair of bytes
+static inline unsigned char multiply_alpha(unsigned char c, unsigned char a) {
+    unsigned int t = c * a + 128;
+    return (unsigned char) ((t + (t >> 8)) >> 8);
+}
+
+/**
+ * Scalar
+ */
+
+void pixels_flip_rows_scalar(unsigned char *pixels, int width, int height, int channels) {
+    size_t row_size = (size_t) width * channels;
+    for (int y = 0; y < height / 2; ++y) {
+        unsigned char *top = pixels + y * row_size;
+        unsigned char *bottom = pixels + (height - 1 - y) * row_size;
+        for (size_t x = 0; x < row_size; ++x) {
+            unsigned char texel = top[x];
+            top[x] = bottom[x];
+            bottom[x] = texel;
+        }
+    }
+}
+
+void pixels_rgb_to_rgba_scalar(const unsigned char *rgb, unsigned char *rgba, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        rgba[i * 4] = rgb[i * 3];
+        rgba[i * 4 + 1] = rgb[i * 3 + 1];
+        rgba[i * 4 + 2] = rgb[i * 3 + 2];
+        rgba[i * 4 + 3] = 255;
+    }
+}
+
+void pixels_premultiply_alpha_scalar(unsigned char *rgba, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        unsigned char *texel = rgba + i * 4;
+        texel[0] = multiply_alpha(texel[0], texel[3]);
+        texel[1] = multiply_alpha(texel[1], texel[3]);
+        texel[2] = multiply_alpha(texel[2], texel[3]);
+    }
+}
+
+void pixels_pack_rgb565_scalar(const unsigned char *rgba, uint16_t *result, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const unsigned char *texel = rgba + i * 4;
+        result[i] = (uint16_t) ((texel[0] >> 3) << 11 | (texel[1] >> 2) << 5 | texel[2] >> 3);
+    }
+}
+
+void pixels_pack_rgba4444_scalar(const unsigned char *rgba, uint16_t *result, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const unsigned char *texel = rgba + i * 4;
+        result[i] = (uint16_t) ((texel[0] >> 4) << 12 | (texel[1] >> 4) << 8 | (texel[2] >> 4) << 4 | texel[3] >> 4);
+    }
+}
+
+void pixels_pack_rgba5551_scalar(const unsigned char *rgba, uint16_t *result, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const unsigned char *texel = rgba + i * 4;
+        result[i] = (uint16_t) ((texel[0] >> 3) << 11 | (texel[1] >> 3) << 6 | (texel[2] >> 3) << 1 | texel[3] >> 7);
+    }
+}
+
+void pixels_extract_channel_scalar(const unsigned char *pixels, int channels, int channel, unsigned char *result,
+                                   size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        result[i] = pixels[i * channels + channel];
+    }
+}
+
+/**
+ * Vectorized, the scalar loops finish the texels that do not fill a vector
+ */
+
+void pixels_flip_rows(unsigned char *pixels, int width, int height, int channels) {
+    size_t row_size = (size_t) width * channels;
+    for (int y = 0; y < height / 2; ++y) {
+        unsigned char *top = pixels + y * row_size;
+        unsigned char *bottom = pixels + (height - 1 - y) * row_size;
+        size_t x = 0;
+#if defined(PIXELS_NEON)
+        for (; x + 16 <= row_size; x += 16) {
+            uint8x16_t top_bytes = vld1q_u8(top + x);
+            vst1q_u8(top + x, vld1q_u8(bottom + x));
+            vst1q_u8(bottom + x, top_bytes);
+        }
+#elif defined(PIXELS_SSE2)
+        for (; x + 16 <= row_size; x += 16) {
+            __m128i top_bytes = _mm_loadu_si128((const __m128i *) (top + x));
+            _mm_storeu_si128((__m128i *) (top + x), _mm_loadu_si128((const __m128i *) (bottom + x)));
+            _mm_storeu_si128((__m128i *) (bottom + x), top_bytes);
+        }
+#endif
+        for (; x < row_size; ++x) {
+            unsigned char texel = top[x];
+            top[x] = bottom[x];
+            bottom[x] = texel;
+        }
+    }
+}
+
+void pixels_rgb_to_rgba(const unsigned char *rgb, unsigned char *rgba, size_t count) {
+    size_t i = 0;
+#if defined(PIXELS_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x3_t source = vld3q_u8(rgb + i * 3);
+        uint8x16x4_t texels;
+        texels.val[0] = source.val[0];
+        texels.val[1] = source.val[1];
+        texels.val[2] = source.val[2];
+        texels.val[3] = vdupq_n_u8(255);
+        vst4q_u8(rgba + i * 4, texels);
+    }
+#elif defined(PIXELS_SSSE3)
+    const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32((int) 0xFF000000);
+    // 4 texels from a 16 byte load, the last 4 bytes are the next texels and must exist
+    for (; i + 6 <= count; i += 4) {
+        __m128i source = _mm_loadu_si128((const __m128i *) (rgb + i * 3));
+        _mm_storeu_si128((__m128i *) (rgba + i * 4), _mm_or_si128(_mm_shuffle_epi8(source, spread), alpha));
+    }
+#elif defined(PIXELS_SSE2)
+    // no byte shuffle, a 4 byte load per texel puts it in its lane with the next texel's red where alpha goes
+    const __m128i alpha = _mm_set1_epi32((int) 0xFF000000);
+    for (; i + 5 <= count; i += 4) {
+        const unsigned char *source = rgb + i * 3;
+        int32_t words[4];
+        memcpy(words, source, 4);
+        memcpy(words + 1, source + 3, 4);
+        memcpy(words + 2, source + 6, 4);
+        memcpy(words + 3, source + 9, 4);
+        __m128i texels = _mm_setr_epi32(words[0], words[1], words[2], words[3]);
+        _mm_storeu_si128((__m128i *) (rgba + i * 4), _mm_or_si128(texels, alpha));
+    }
+#endif
+    pixels_rgb_to_rgba_scalar(rgb + i * 3, rgba + i * 4, count - i);
+}
+
+#if defined(PIXELS_NEON)
+static inline uint8x16_t multiply_alpha_neon(uint8x16_t c, uint8x16_t a) {
+    // (t + ((t + 128) >> 8) + 128) >> 8, the same as multiply_alpha
+    uint16x8_t low = vmull_u8(vget_low_u8(c), vget_low_u8(a));
+    uint16x8_t high = vmull_u8(vget_high_u8(c), vget_high_u8(a));
+    return vcombine_u8(vraddhn_u16(low, vrshrq_n_u16(low, 8)), vraddhn_u16(high, vrshrq_n_u16(high, 8)));
+}
+#elif defined(PIXELS_SSE2)
+// 2 texels widened to 16 bits each channel
+static inline __m128i multiply_alpha_sse2(__m128i texels) {
+    const __m128i colour_mask = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+    // alpha * 255 / 255 is alpha, it goes through unchanged
+    const __m128i alpha_factor = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(texels, _MM_SHUFFLE(3, 3, 3, 3)),
+                                        _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i factor = _mm_or_si128(_mm_and_si128(alpha, colour_mask), alpha_factor);
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(texels, factor), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+#endif
+
+void pixels_premultiply_alpha(unsigned char *rgba, size_t count) {
+    size_t i = 0;
+#if defined(PIXELS_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x4_t texels = vld4q_u8(rgba + i * 4);
+        texels.val[0] = multiply_alpha_neon(texels.val[0], texels.val[3]);
+        texels.val[1] = multiply_alpha_neon(texels.val[1], texels.val[3]);
+        texels.val[2] = multiply_alpha_neon(texels.val[2], texels.val[3]);
+        vst4q_u8(rgba + i * 4, texels);
+    }
+#elif defined(PIXELS_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        __m128i texels = _mm_loadu_si128((const __m128i *) (rgba + i * 4));
+        __m128i low = multiply_alpha_sse2(_mm_unpacklo_epi8(texels, zero));
+        __m128i high = multiply_alpha_sse2(_mm_unpackhi_epi8(texels, zero));
+        _mm_storeu_si128((__m128i *) (rgba + i * 4), _mm_packus_epi16(low, high));
+    }
+#endif
+    pixels_premultiply_alpha_scalar(rgba + i * 4, count - i);
+}
+
+#if defined(PIXELS_SSE2)
+// Two vectors of 4 texels, each in the low 16 bits of its 32 bit lane, to one vector of 8 texels. The values are
+// sign extended first so the signed saturation of the pack keeps their bits.
+static inline __m128i pack_texels_sse2(__m128i low, __m128i high) {
+    low = _mm_srai_epi32(_mm_slli_epi32(low, 16), 16);
+    high = _mm_srai_epi32(_mm_slli_epi32(high, 16), 16);
+    return _mm_packs_epi32(low, high);
+}
+
+static inline __m128i rgb565_sse2(__m128i texels) {
+    __m128i r = _mm_slli_epi32(_mm_and_si128(texels, _mm_set1_epi32(0xF8)), 8);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(texels, 5), _mm_set1_epi32(0x7E0));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(texels, 19), _mm_set1_epi32(0x1F));
+    return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+static inline __m128i rgba4444_sse2(__m128i texels) {
+    __m128i r = _mm_slli_epi32(_mm_and_si128(texels, _mm_set1_epi32(0xF0)), 8);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(texels, 4), _mm_set1_epi32(0xF00));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(texels, 16), _mm_set1_epi32(0xF0));
+    __m128i a = _mm_srli_epi32(texels, 28);
+    return _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, a));
+}
+
+static inline __m128i rgba5551_sse2(__m128i texels) {
+    __m128i r = _mm_slli_epi32(_mm_and_si128(texels, _mm_set1_epi32(0xF8)), 8);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(texels, 5), _mm_set1_epi32(0x7C0));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(texels, 18), _mm_set1_epi32(0x3E));
+    __m128i a = _mm_srli_epi32(texels, 31);
+    return _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, a));
+}
+
+#define PACK_TEXELS_SSE2(rgba, result, count, i, pack) \
+    for (; (i) + 8 <= (count); (i) += 8) { \
+        __m128i low = pack(_mm_loadu_si128((const __m128i *) ((rgba) + (i) * 4))); \
+        __m128i high = pack(_mm_loadu_si128((const __m128i *) ((rgba) + (i) * 4 + 16))); \
+        _mm_storeu_si128((__m128i *) ((result) + (i)), pack_texels_sse2(low, high)); \
+    }
+#endif
+
+// Inserting shifts keep the top bits of what is there, each channel lands under the previous one
+void pixels_pack_rgb565(const unsigned char *rgba, uint16_t *result, size_t count) {
+    size_t i = 0;
+#if defined(PIXELS_NEON)
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t texels = vld4_u8(rgba + i * 4);
+        uint16x8_t packed = vshll_n_u8(texels.val[0], 8);
+        packed = vsriq_n_u16(packed, vshll_n_u8(texels.val[1], 8), 5);
+        packed = vsriq_n_u16(packed, vshll_n_u8(texels.val[2], 8), 11);
+        vst1q_u16(result + i, packed);
+    }
+#elif defined(PIXELS_SSE2)
+    PACK_TEXELS_SSE2(rgba, result, count, i, rgb565_sse2)
+#endif
+    pixels_pack_rgb565_scalar(rgba + i * 4, result + i, count - i);
+}
+
+void pixels_pack_rgba4444(const unsigned char *rgba, uint16_t *result, size_t count) {
+    size_t i = 0;
+#if defined(PIXELS_NEON)
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t texels = vld4_u8(rgba + i * 4);
+        uint16x8_t packed = vshll_n_u8(texels.val[0], 8);
+        packed = vsriq_n_u16(packed, vshll_n_u8(texels.val[1], 8), 4);
+        packed = vsriq_n_u16(packed, vshll_n_u8(texels.val[2], 8), 8);
+        packed = vsriq_n_u16(packed, vshll_n_u8(texels.val[3], 8), 12);
+        vst1q_u16(result + i, packed);
+    }
+#elif defined(PIXELS_SSE2)
+    PACK_TEXELS_SSE2(rgba, result, count, i, rgba4444_sse2)
+#endif
+    pixels_pack_rgba4444_scalar(rgba + i * 4, result + i, count - i);
+}
+
+void pixels_pack_rgba5551(const unsigned char *rgba, uint16_t *result, size_t count) {
+    size_t i = 0;
+#if defined(PIXELS_NEON)
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t texels = vld4_u8(rgba + i * 4);
+        uint16x8_t packed = vshll_n_u8(texels.val[0], 8);
+        packed = vsriq_n_u16(packed, vshll_n_u8(texels.val[1], 8), 5);
+        packed = vsriq_n_u16(packed, vshll_n_u8(texels.val[2], 8), 10);
+        packed = vsriq_n_u16(packed, vshll_n_u8(texels.val[3], 8), 15);
+        vst1q_u16(result + i, packed);
+    }
+#elif defined(PIXELS_SSE2)
+    PACK_TEXELS_SSE2(rgba, result, count, i, rgba5551_sse2)
+#endif
+    pixels_pack_rgba5551_scalar(rgba + i * 4, result + i, count - i);
+}
+
+void pixels_extract_channel(const unsigned char *pixels, int channels, int channel, unsigned char *result,
+                            size_t count) {
+    size_t i = 0;
+#if defined(PIXELS_NEON)
+    if (channels == 4) {
+        for (; i + 16 <= count; i += 16) {
+            vst1q_u8(result + i, vld4q_u8(pixels + i * 4).val[channel]);
+        }
+    } else if (channels == 3) {
+        for (; i + 16 <= count; i += 16) {
+            vst1q_u8(result + i, vld3q_u8(pixels + i * 3).val[channel]);
+        }
+    } else if (channels == 2) {
+        for (; i + 16 <= count; i += 16) {
+            vst1q_u8(result + i, vld2q_u8(pixels + i * 2).val[channel]);
+        }
+    }
+#elif defined(PIXELS_SSE2)
+    if (channels == 4) {
+        const __m128i byte_mask = _mm_set1_epi32(0xFF);
+        const __m128i shift = _mm_cvtsi32_si128(channel * 8);
+        for (; i + 16 <= count; i += 16) {
+            const auto *source = (const __m128i *) (pixels + i * 4);
+            __m128i a = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(source), shift), byte_mask);
+            __m128i b = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(source + 1), shift), byte_mask);
+            __m128i c = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(source + 2), shift), byte_mask);
+            __m128i d = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(source + 3), shift), byte_mask);
+            _mm_storeu_si128((__m128i *) (result + i),
+                             _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+        }
+    }
+#endif
+    pixels_extract_channel_scalar(pixels + i * channels, channels, channel, result + i, count - i);
+}
@@ -0,0 +1,54 @@
+//
+// Pixel conversion kernels for texture preparation: row flips, channel expansion and extraction, alpha
+// premultiplication and 16 bit texel packing. NEON on ARM, SSE2 (SSSE3 where it helps) on x86, the plain loops
+// elsewhere. No GL calls, safe on the loader jobs.
+//
+// Every kernel has a _scalar twin with the same results, the reference for tools/bench_pixels.
+//
+
+#ifndef BLOCKS_GP_PIXELS_H
+#define BLOCKS_GP_PIXELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Instruction set the kernels were built for
+const char *pixels_simd_name();
+
+// Swaps the rows top to bottom in place
+void pixels_flip_rows(unsigned char *pixels, int width, int height, int channels);
+
+void pixels_flip_rows_scalar(unsigned char *pixels, int width, int height, int channels);
+
+// count RGB texels to RGBA, alpha 255
+void pixels_rgb_to_rgba(const unsigned char *rgb, unsigned char *rgba, size_t count);
+
+void pixels_rgb_to_rgba_scalar(const unsigned char *rgb, unsigned char *rgba, size_t count);
+
+// In place, colour * alpha / 255 rounded to nearest
+void pixels_premultiply_alpha(unsigned char *rgba, size_t count);
+
+void pixels_premultiply_alpha_scalar(unsigned char *rgba, size_t count);
+
+// RGBA8 to the 16 bit texels of GL_UNSIGNED_SHORT_5_6_5 (alpha dropped), GL_UNSIGNED_SHORT_4_4_4_4 and
+// GL_UNSIGNED_SHORT_5_5_5_1, red in the high bits. The low bits of every channel are cut, not rounded.
+void pixels_pack_rgb565(const unsigned char *rgba, uint16_t *result, size_t count);
+
+void pixels_pack_rgba4444(const unsigned char *rgba, uint16_t *result, size_t count);
+
+void pixels_pack_rgba5551(const unsigned char *rgba, uint16_t *result, size_t count);
+
+void pixels_pack_rgb565_scalar(const unsigned char *rgba, uint16_t *result, size_t count);
+
+void pixels_pack_rgba4444_scalar(const unsigned char *rgba, uint16_t *result, size_t count);
+
+void pixels_pack_rgba5551_scalar(const unsigned char *rgba, uint16_t *result, size_t count);
+
+// channel of count texels of channels each into a one byte per texel image (GL_LUMINANCE / GL_ALPHA)
+void pixels_extract_channel(const unsigned char *pixels, int channels, int channel, unsigned char *result,
+                            size_t count);
+
+void pixels_extract_channel_scalar(const unsigned char *pixels, int channels, int channel, unsigned char *result,
+                                   size_t count);
+
+#endif //BLOCKS_GP_PIXELS_H
@@ -5,20 +5,55 @@
 #ifndef BLOCKS_GP_PLATFORM_H
 #define BLOCKS_GP_PLATFORM_H
 
+#include <cstddef>
+#include <cstdio>
+
 #include "stb_image.h"
 
 // @TODO remove define
+// Host tools are built with -DBUILD_LINUX, everything else is the Android build.
+#if !defined(BUILD_LINUX) && !defined(BUILD_MACOSX)
 #define BUILD_ANDROID
+#endif
+
+// Read-only view of a whole file. The memory is owned by the platform layer and must be
+// released with unmap_file.
+typedef struct {
+    const void *data;
+    size_t size;
+    void *handle;
+} FileView;
+
+// Sequential reader, read returns the number of bytes written to buffer, 0 at the end of the file and -1 when
+// reading failed.
+typedef struct {
+    void *handle;
+    int (*read)(void *handle, char *buffer, int size);
+    void (*close)(void *handle);
+} FileReader;
 
 #define PLATFORM_LOGI_FMT(name) void name(const char* fmt, ...)
 #define PLATFORM_LOGI_STR(name) void name(const char* str)
 #define PLATFORM_READ_ENTIRE_FILE(name) char* name(const char* file_name, char mode)
+#define PLATFORM_MAP_FILE(name) bool name(const char* file_name, FileView* view)
+#define PLATFORM_UNMAP_FILE(name) void name(FileView* view)
+#define PLATFORM_OPEN_FILE_READER(name) bool name(const char* file_name, FileReader* reader)
+// Read only stdio FILE over an asset. Nothing loads through it, it is only the baseline of benchmark_image_decode.
+#define PLATFORM_OPEN_ASSET_STDIO(name) FILE* name(const char* file_name)
 
 #ifdef BUILD_ANDROID
 
 PLATFORM_READ_ENTIRE_FILE(android_read_entire_file);
+PLATFORM_MAP_FILE(android_map_file);
+PLATFORM_UNMAP_FILE(android_unmap_file);
+PLATFORM_OPEN_FILE_READER(android_open_file_reader);
+PLATFORM_OPEN_ASSET_STDIO(android_open_asset_stdio);
 
-#define read_entire_file android_read_entire_file
+#define platform_read_entire_file android_read_entire_file
+#define platform_map_file android_map_file
+#define platform_unmap_file android_unmap_file
+#define platform_open_file_reader android_open_file_reader
+#define open_asset_stdio android_open_asset_stdio
 
 PLATFORM_LOGI_STR(android_log_str);
 PLATFORM_LOGI_FMT(android_log_fmt);
@@ -28,8 +63,47 @@ PLATFORM_LOGI_FMT(android_log_fmt);
 
 #endif
 
+#ifdef BUILD_LINUX
+
+PLATFORM_READ_ENTIRE_FILE(linux_read_entire_file);
+PLATFORM_MAP_FILE(linux_map_file);
+PLATFORM_UNMAP_FILE(linux_unmap_file);
+PLATFORM_OPEN_FILE_READER(linux_open_file_reader);
+PLATFORM_OPEN_ASSET_STDIO(linux_open_asset_stdio);
+
+#define platform_read_entire_file linux_read_entire_file
+#define platform_map_file linux_map_file
+#define platform_unmap_file linux_unmap_file
+#define platform_open_file_reader linux_open_file_reader
+#define open_asset_stdio linux_open_asset_stdio
+
+PLATFORM_LOGI_STR(linux_log_str);
+PLATFORM_LOGI_FMT(linux_log_fmt);
+
+#define log_str linux_log_str
+#define log_fmt(...) linux_log_fmt(__VA_ARGS__)
+
+#endif
+
 #ifdef BUILD_MACOSX
 #define load_entire_file mac_load_entire_file
 #endif
 
+// Virtual file system (gp_vfs.cpp). Files are looked up in the mounted asset pack (gp_pack.h) first and on the
+// platform after that. Views of stored pack entries point straight into the pack mapping, compressed entries
+// are inflated into a heap block that unmap_file releases.
+bool vfs_mount(const char *pack_name);
+
+void vfs_unmount();
+
+PLATFORM_READ_ENTIRE_FILE(vfs_read_entire_file);
+PLATFORM_MAP_FILE(vfs_map_file);
+PLATFORM_UNMAP_FILE(vfs_unmap_file);
+PLATFORM_OPEN_FILE_READER(vfs_open_file_reader);
+
+#define read_entire_file vfs_read_entire_file
+#define map_file vfs_map_file
+#define unmap_file vfs_unmap_file
+#define open_file_reader vfs_open_file_reader
+
 #endif //BLOCKS_GP_PLATFORM_H
@@ -0,0 +1,177 @@
+//
+// Draw packets collected over a frame and drawn in the order of their 64 bit sort keys, so game code submits in
+// any order. The keys group draws by layer, then opaque before blended. Opaque draws are grouped by program and
+// texture and go front to back for early depth rejection. Blended draws go back to front, then by program and
+// texture.
+//
+// Key bits, high to low:
+//   opaque   [layer 8][0][program 8][texture 16][depth 24][7 unused]
+//   blended  [layer 8][1][inverted depth 24][program 8][texture 16][7 unused]
+// Program and texture are the low bits of their GL names, a collision only costs a state change. An instanced
+// packet draws many copies of a mesh at once and is keyed by its nearest instance.
+//
+
+#ifndef BLOCKS_GP_RENDER_QUEUE_H
+#define BLOCKS_GP_RENDER_QUEUE_H
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include "gp_model.h"
+#include "gp_atlas.h"
+#include "gp_shader.h"
+
+#define RENDER_QUEUE_MAX_PACKETS 128
+// View distance mapped onto the depth bits, farther draws share the last value
+#define RENDER_QUEUE_DEPTH_RANGE 100.0f
+#define RENDER_QUEUE_DEPTH_BITS 24
+
+typedef struct {
+    ShaderProgram *shader;
+    const TextureRegion *texture;
+    // alpha blended, drawn back to front after the opaque draws of its layer
+    bool blended;
+} RenderMaterial;
+
+typedef struct {
+    SModelData *mesh;
+    const RenderMaterial *material;
+    float transform[16];
+    // instance_count model matrices instead of transform, owned by the caller until the packet is drawn. Null for
+    // a single draw.
+    const float *instances;
+    int instance_count;
+    // detail level of this instance, or one per instance, kept by the caller between frames (see mesh_select_lod)
+    int *lod;
+    // lower layers are drawn first
+    uint8_t layer;
+} RenderPacket;
+
+typedef struct {
+    uint64_t key;
+    uint32_t packet;
+} RenderQueueEntry;
+
+typedef struct {
+    int count;
+    RenderPacket packets[RENDER_QUEUE_MAX_PACKETS];
+    // sorted by render_queue_sort
+    RenderQueueEntry entries[RENDER_QUEUE_MAX_PACKETS];
+    RenderQueueEntry scratch[RENDER_QUEUE_MAX_PACKETS];
+} RenderQueue;
+
+void render_queue_clear(RenderQueue *queue) {
+    queue->count = 0;
+}
+
+// depth is the view distance over RENDER_QUEUE_DEPTH_RANGE, in [0, 1]
+uint64_t render_queue_key(uint8_t layer, bool blended, GLuint program, GLuint texture, float depth) {
+    const uint32_t depth_max = (1u << RENDER_QUEUE_DEPTH_BITS) - 1;
+    depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+    auto depth_bits = (uint64_t) (depth * depth_max);
+    uint64_t key = (uint64_t) layer << 56;
+    if (blended) {
+        key |= (uint64_t) 1 << 55;
+        key |= (depth_max - depth_bits) << 31;
+        key |= (uint64_t) (program & 0xFF) << 23;
+        key |= (uint64_t) (texture & 0xFFFF) << 7;
+    } else {
+        key |= (uint64_t) (program & 0xFF) << 47;
+        key |= (uint64_t) (texture & 0xFFFF) << 31;
+        key |= depth_bits << 7;
+    }
+    return key;
+}
+
+// Distance from the camera to the origin of transform, over RENDER_QUEUE_DEPTH_RANGE
+float render_queue_depth(const float transform[16], const float view_matrix[16]) {
+    // view space z of the origin, the camera looks down -z
+    float view_z = view_matrix[2] * transform[12] + view_matrix[6] * transform[13] +
+                   view_matrix[10] * transform[14] + view_matrix[14];
+    return -view_z / RENDER_QUEUE_DEPTH_RANGE;
+}
+
+RenderPacket *render_queue_push(RenderQueue *queue, SModelData *mesh, const RenderMaterial *material, int *lod,
+                                uint8_t layer, float depth) {
+    assert(queue->count < RENDER_QUEUE_MAX_PACKETS);
+    int index = queue->count++;
+    RenderPacket *packet = &queue->packets[index];
+    packet->mesh = mesh;
+    packet->material = material;
+    packet->instances = nullptr;
+    packet->instance_count = 0;
+    packet->lod = lod;
+    packet->layer = layer;
+    queue->entries[index].key = render_queue_key(layer, material->blended, material->shader->program,
+                                                 material->texture->texture, depth);
+    queue->entries[index].packet = (uint32_t) index;
+    return packet;
+}
+
+// The key takes the distance from the camera to the origin of transform
+void render_queue_submit(RenderQueue *queue, SModelData *mesh, const RenderMaterial *material,
+                         const float transform[16], int *lod, uint8_t layer, const float view_matrix[16]) {
+    RenderPacket *packet = render_queue_push(queue, mesh, material, lod, layer,
+                                             render_queue_depth(transform, view_matrix));
+    memcpy(packet->transform, transform, sizeof(packet->transform));
+}
+
+// count instances of mesh, a model matrix each in transforms and a detail level each in lods. The key takes the
+// nearest instance.
+void render_queue_submit_instanced(RenderQueue *queue, SModelData *mesh, const RenderMaterial *material,
+                                   const float *transforms, int count, int *lods, uint8_t layer,
+                                   const float view_matrix[16]) {
+    assert(count > 0);
+    float depth = render_queue_depth(transforms, view_matrix);
+    for (int i = 1; i < count; ++i) {
+        float instance_depth = render_queue_depth(transforms + i * 16, view_matrix);
+        depth = instance_depth < depth ? instance_depth : depth;
+    }
+    RenderPacket *packet = render_queue_push(queue, mesh, material, lods, layer, depth);
+    memcpy(packet->transform, transforms, sizeof(packet->transform));
+    packet->instances = transforms;
+    packet->instance_count = count;
+}
+
+// LSD radix sort of the keys a byte at a time, stable, skipping the bytes every key has in common
+void render_queue_sort(RenderQueue *queue) {
+    RenderQueueEntry *source = queue->entries;
+    RenderQueueEntry *destination = queue->scratch;
+    int count = queue->count;
+    if (count < 2) {
+        return;
+    }
+    for (int shift = 0; shift < 64; shift += 8) {
+        uint32_t offsets[256];
+        memset(offsets, 0, sizeof(offsets));
+        for (int i = 0; i < count; ++i) {
+            offsets[(source[i].key >> shift) & 0xFF]++;
+        }
+        if (offsets[(source[0].key >> shift) & 0xFF] == (uint32_t) count) {
+            continue;
+        }
+        uint32_t offset = 0;
+        for (int digit = 0; digit < 256; ++digit) {
+            uint32_t digit_count = offsets[digit];
+            offsets[digit] = offset;
+            offset += digit_count;
+        }
+        for (int i = 0; i < count; ++i) {
+            destination[offsets[(source[i].key >> shift) & 0xFF]++] = source[i];
+        }
+        RenderQueueEntry *sorted = destination;
+        destination = source;
+        source = sorted;
+    }
+    if (source != queue->entries) {
+        memcpy(queue->entries, source, sizeof(RenderQueueEntry) * count);
+    }
+}
+
+// i-th packet in key order once sorted
+const RenderPacket *render_queue_packet(const RenderQueue *queue, int i) {
+    return &queue->packets[queue->entries[i].packet];
+}
+
+#endif //BLOCKS_GP_RENDER_QUEUE_H
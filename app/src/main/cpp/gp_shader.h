@@ -0,0 +1,173 @@
+//
+// Linked programs with their active uniforms and attributes read once at link time. Draws address them by the
+// SHADER_UNIFORM_* / SHADER_ATTRIBUTE_* handles, never by name, and every uniform keeps the last value uploaded
+// so setting the same value again skips the glUniform* call. GL keeps uniform values per program, the shadow
+// stays valid across glUseProgram. Render thread only.
+//
+
+#ifndef BLOCKS_GP_SHADER_H
+#define BLOCKS_GP_SHADER_H
+
+#include <cassert>
+#include <cstring>
+
+#include "gp_gl.h"
+
+#define SHADER_MAX_UNIFORMS 16
+#define SHADER_NAME_LENGTH 32
+// A mat4
+#define SHADER_UNIFORM_MAX_BYTES 64
+
+// Uniforms the engine shaders share, a program without one of them (declared but unused is optimized out) ignores
+// its setters
+typedef enum {
+    SHADER_UNIFORM_MODEL_MATRIX,
+    SHADER_UNIFORM_VIEW_MATRIX,
+    SHADER_UNIFORM_PROJECTION_MATRIX,
+    SHADER_UNIFORM_POSITION_OFFSET,
+    SHADER_UNIFORM_POSITION_SCALE,
+    SHADER_UNIFORM_UV_OFFSET,
+    SHADER_UNIFORM_UV_SCALE,
+    SHADER_UNIFORM_TEXTURE_UNIT,
+    SHADER_UNIFORM_INSTANCE_MATRICES,
+    SHADER_UNIFORM_COUNT
+} ShaderUniformHandle;
+
+static const char *shader_uniform_names[SHADER_UNIFORM_COUNT] = {
+        "model_matrix", "view_matrix", "projection_matrix", "position_offset", "position_scale", "uv_offset",
+        "uv_scale", "texture_unit", "instance_matrices"};
+
+typedef enum {
+    SHADER_ATTRIBUTE_POSITION,
+    SHADER_ATTRIBUTE_UVS,
+    // a mat4, four locations from this one
+    SHADER_ATTRIBUTE_INSTANCE_MATRIX,
+    SHADER_ATTRIBUTE_INSTANCE_INDEX,
+    SHADER_ATTRIBUTE_COUNT
+} ShaderAttributeHandle;
+
+static const char *shader_attribute_names[SHADER_ATTRIBUTE_COUNT] = {"vertex_position", "vertex_uvs",
+                                                                     "instance_matrix", "instance_index"};
+
+typedef struct {
+    char name[SHADER_NAME_LENGTH];
+    GLint location;
+    GLenum type;
+    // the last value uploaded, once set
+    bool set;
+    unsigned char value[SHADER_UNIFORM_MAX_BYTES];
+} ShaderUniform;
+
+typedef struct {
+    GLuint program;
+    // every active uniform
+    int uniform_count;
+    ShaderUniform uniforms[SHADER_MAX_UNIFORMS];
+    // SHADER_UNIFORM_* to its index in uniforms, -1 when the program does not have it
+    int handles[SHADER_UNIFORM_COUNT];
+    // SHADER_ATTRIBUTE_* to its location, -1 when the program does not have it
+    GLint attributes[SHADER_ATTRIBUTE_COUNT];
+    // since shader_program_create
+    int uniform_uploads;
+    int uniform_skips;
+} ShaderProgram;
+
+// Index in uniforms, -1 when the program has no active uniform called name
+int shader_find_uniform(const ShaderProgram *shader, const char *name) {
+    for (int i = 0; i < shader->uniform_count; ++i) {
+        if (strcmp(shader->uniforms[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void shader_program_create(ShaderProgram *shader, const char *vertex_source, const char *fragment_source) {
+    memset(shader, 0, sizeof(ShaderProgram));
+    shader->program = create_program(vertex_source, fragment_source);
+
+    GLint active_uniforms = 0;
+    glGetProgramiv(shader->program, GL_ACTIVE_UNIFORMS, &active_uniforms);
+    assert(active_uniforms <= SHADER_MAX_UNIFORMS);
+    for (int i = 0; i < active_uniforms; ++i) {
+        ShaderUniform *uniform = &shader->uniforms[shader->uniform_count++];
+        GLint size;
+        glGetActiveUniform(shader->program, i, SHADER_NAME_LENGTH, nullptr, &size, &uniform->type, uniform->name);
+        // arrays are reported as "name[0]"
+        char *bracket = strchr(uniform->name, '[');
+        if (bracket) {
+            *bracket = '\0';
+        }
+        uniform->location = glGetUniformLocation(shader->program, uniform->name);
+    }
+    for (int i = 0; i < SHADER_UNIFORM_COUNT; ++i) {
+        shader->handles[i] = shader_find_uniform(shader, shader_uniform_names[i]);
+    }
+    for (int i = 0; i < SHADER_ATTRIBUTE_COUNT; ++i) {
+        shader->attributes[i] = glGetAttribLocation(shader->program, shader_attribute_names[i]);
+    }
+    log_fmt("shader program %d: %d uniforms, position %d, uvs %d", shader->program, shader->uniform_count,
+            shader->attributes[SHADER_ATTRIBUTE_POSITION], shader->attributes[SHADER_ATTRIBUTE_UVS]);
+}
+
+// The uniform to upload value to, null when it is not in the program or already holds value
+ShaderUniform *shader_uniform_changed(ShaderProgram *shader, ShaderUniformHandle handle, GLenum type,
+                                      const void *value, size_t size) {
+    int index = shader->handles[handle];
+    if (index < 0) {
+        return nullptr;
+    }
+    ShaderUniform *uniform = &shader->uniforms[index];
+    assert(uniform->type == type || (type == GL_INT && uniform->type == GL_SAMPLER_2D));
+    if (uniform->set && memcmp(uniform->value, value, size) == 0) {
+        shader->uniform_skips++;
+        return nullptr;
+    }
+    memcpy(uniform->value, value, size);
+    uniform->set = true;
+    shader->uniform_uploads++;
+    return uniform;
+}
+
+// The setters upload to the program in use
+
+void shader_set_int(ShaderProgram *shader, ShaderUniformHandle handle, int value) {
+    ShaderUniform *uniform = shader_uniform_changed(shader, handle, GL_INT, &value, sizeof(value));
+    if (uniform) {
+        glUniform1i(uniform->location, value);
+    }
+}
+
+void shader_set_vec2(ShaderProgram *shader, ShaderUniformHandle handle, const float *value) {
+    ShaderUniform *uniform = shader_uniform_changed(shader, handle, GL_FLOAT_VEC2, value, sizeof(float) * 2);
+    if (uniform) {
+        glUniform2fv(uniform->location, 1, value);
+    }
+}
+
+void shader_set_vec3(ShaderProgram *shader, ShaderUniformHandle handle, const float *value) {
+    ShaderUniform *uniform = shader_uniform_changed(shader, handle, GL_FLOAT_VEC3, value, sizeof(float) * 3);
+    if (uniform) {
+        glUniform3fv(uniform->location, 1, value);
+    }
+}
+
+void shader_set_mat4(ShaderProgram *shader, ShaderUniformHandle handle, const float *value) {
+    ShaderUniform *uniform = shader_uniform_changed(shader, handle, GL_FLOAT_MAT4, value, sizeof(float) * 16);
+    if (uniform) {
+        glUniformMatrix4fv(uniform->location, 1, GL_FALSE, value);
+    }
+}
+
+// count matrices from the first element of a uniform array. Arrays are not shadowed, every call uploads.
+void shader_set_mat4_array(ShaderProgram *shader, ShaderUniformHandle handle, const float *value, int count) {
+    int index = shader->handles[handle];
+    if (index < 0) {
+        return;
+    }
+    assert(shader->uniforms[index].type == GL_FLOAT_MAT4);
+    shader->uniform_uploads++;
+    glUniformMatrix4fv(shader->uniforms[index].location, count, GL_FALSE, value);
+}
+
+#endif //BLOCKS_GP_SHADER_H
@@ -0,0 +1,260 @@
+//
+// GPU memory budget for the loaded textures. Every texture remembers how it was requested from the loader, so
+// it can be evicted (its image replaced by the placeholder) or lose its largest mip levels, and be loaded again
+// from the asset pack later. The texture names never change, regions and models holding them stay valid.
+//
+// Draws touch the textures they sample, the least recently used ones go first. Render thread only.
+//
+
+#ifndef BLOCKS_GP_TEXTURE_BUDGET_H
+#define BLOCKS_GP_TEXTURE_BUDGET_H
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "gp_loader.h"
+#include "gp_image.h"
+
+#define TEXTURE_BUDGET_MAX_TEXTURES 32
+// Textures drawn in the last frames are not evicted, they lose their top levels instead
+#define TEXTURE_BUDGET_IDLE_FRAMES 120
+// Frames after the last trim before dropped levels are loaded again
+#define TEXTURE_BUDGET_RESTORE_FRAMES 600
+
+typedef struct {
+    GLuint texture;
+    // the request that loads it again
+    char path[LOADER_PATH_LENGTH];
+    LoaderFunction load;
+    LoaderFunction upload;
+    void *target;
+    int flags;
+    // the full chain, as the last upload reported it
+    int level_count;
+    size_t level_bytes[IMAGE_MAX_LEVELS];
+    // largest levels left out of the GL texture
+    int dropped_levels;
+    // in GL memory, or about to be once the pending load is uploaded
+    size_t bytes;
+    uint32_t last_used_frame;
+    bool evicted;
+    bool loading;
+} BudgetTexture;
+
+typedef struct {
+    size_t budget;
+    uint32_t frame;
+    uint32_t last_trim_frame;
+    int count;
+    BudgetTexture textures[TEXTURE_BUDGET_MAX_TEXTURES];
+    // since texture_budget_init
+    int evictions;
+    int dropped_levels;
+    int reloads;
+} TextureBudget;
+
+void texture_budget_init(TextureBudget *budget, size_t budget_bytes) {
+    memset(budget, 0, sizeof(TextureBudget));
+    budget->budget = budget_bytes;
+}
+
+BudgetTexture *texture_budget_find(TextureBudget *budget, GLuint texture) {
+    for (int i = 0; i < budget->count; ++i) {
+        if (budget->textures[i].texture == texture) {
+            return &budget->textures[i];
+        }
+    }
+    return nullptr;
+}
+
+// texture is loaded by loader_submit(path, load, upload, target, flags), which the caller already did. upload
+// must leave out texture_budget_dropped_levels levels and report the chain with texture_budget_uploaded.
+void texture_budget_add(TextureBudget *budget, GLuint texture, const char *path, LoaderFunction load,
+                        LoaderFunction upload, void *target, int flags) {
+    assert(budget->count < TEXTURE_BUDGET_MAX_TEXTURES);
+    BudgetTexture *entry = &budget->textures[budget->count++];
+    memset(entry, 0, sizeof(BudgetTexture));
+    entry->texture = texture;
+    snprintf(entry->path, sizeof(entry->path), "%s", path);
+    entry->load = load;
+    entry->upload = upload;
+    entry->target = target;
+    entry->flags = flags;
+    entry->last_used_frame = budget->frame;
+    entry->loading = true;
+}
+
+// For textures that stop being managed, before they are deleted
+void texture_budget_remove(TextureBudget *budget, GLuint texture) {
+    BudgetTexture *entry = texture_budget_find(budget, texture);
+    if (entry) {
+        *entry = budget->textures[--budget->count];
+    }
+}
+
+size_t texture_budget_resident(const TextureBudget *budget) {
+    size_t bytes = 0;
+    for (int i = 0; i < budget->count; ++i) {
+        bytes += budget->textures[i].bytes;
+    }
+    return bytes;
+}
+
+// Bytes of entry with dropped levels left out
+size_t texture_budget_chain_bytes(const BudgetTexture *entry, int dropped) {
+    size_t bytes = 0;
+    for (int i = dropped; i < entry->level_count; ++i) {
+        bytes += entry->level_bytes[i];
+    }
+    return bytes;
+}
+
+// Levels the upload of texture leaves out, 0 for textures without a budget
+int texture_budget_dropped_levels(TextureBudget *budget, GLuint texture) {
+    BudgetTexture *entry = texture_budget_find(budget, texture);
+    return entry ? entry->dropped_levels : 0;
+}
+
+// level_bytes are the GL sizes of the full chain the upload had, dropped levels included
+void texture_budget_uploaded(TextureBudget *budget, GLuint texture, const size_t *level_bytes, int level_count) {
+    BudgetTexture *entry = texture_budget_find(budget, texture);
+    if (!entry) {
+        return;
+    }
+    entry->level_count = level_count;
+    memcpy(entry->level_bytes, level_bytes, sizeof(size_t) * level_count);
+    if (entry->dropped_levels >= level_count) {
+        entry->dropped_levels = level_count - 1;
+    }
+    entry->bytes = texture_budget_chain_bytes(entry, entry->dropped_levels);
+    entry->evicted = false;
+    entry->loading = false;
+}
+
+// False when the loader queue is full, the entry is left as it was for the next touch or fit to try again
+bool texture_budget_reload(TextureBudget *budget, BudgetTexture *entry) {
+    // a load in flight picks up the new dropped_levels when it is uploaded
+    if (!entry->loading) {
+        if (!loader_submit(entry->path, entry->load, entry->upload, entry->target, entry->flags)) {
+            return false;
+        }
+        entry->loading = true;
+        budget->reloads++;
+    }
+    entry->bytes = texture_budget_chain_bytes(entry, entry->dropped_levels);
+    return true;
+}
+
+// Every draw sampling texture, evicted textures are loaded again
+void texture_budget_touch(TextureBudget *budget, GLuint texture) {
+    BudgetTexture *entry = texture_budget_find(budget, texture);
+    if (!entry) {
+        return;
+    }
+    entry->last_used_frame = budget->frame;
+    if (entry->evicted && !entry->loading && texture_budget_reload(budget, entry)) {
+        log_fmt("texture budget: loading %s again", entry->path);
+        entry->evicted = false;
+    }
+}
+
+void texture_budget_evict(TextureBudget *budget, BudgetTexture *entry) {
+    log_fmt("texture budget: evicting %s, %d KB", entry->path, (int) (entry->bytes / 1024));
+    upload_placeholder_texture(entry->texture);
+    entry->bytes = 0;
+    entry->evicted = true;
+    budget->evictions++;
+}
+
+// False when it can not be loaded again without the level yet
+bool texture_budget_drop_level(TextureBudget *budget, BudgetTexture *entry) {
+    entry->dropped_levels++;
+    if (!texture_budget_reload(budget, entry)) {
+        entry->dropped_levels--;
+        return false;
+    }
+    log_fmt("texture budget: %s drops its top level, %d levels left, %d KB", entry->path,
+            entry->level_count - entry->dropped_levels, (int) (entry->bytes / 1024));
+    budget->dropped_levels++;
+    return true;
+}
+
+// Gets the resident bytes down to target. Textures idle for idle_frames are evicted, least recently used first,
+// then the ones in use lose their top level, least recently used first.
+void texture_budget_fit(TextureBudget *budget, size_t target, uint32_t idle_frames) {
+    while (texture_budget_resident(budget) > target) {
+        BudgetTexture *idle = nullptr;
+        BudgetTexture *in_use = nullptr;
+        for (int i = 0; i < budget->count; ++i) {
+            BudgetTexture *entry = &budget->textures[i];
+            if (entry->bytes == 0) {
+                continue;
+            }
+            bool is_idle = budget->frame - entry->last_used_frame >= idle_frames;
+            if (is_idle && !entry->loading) {
+                if (!idle || entry->last_used_frame < idle->last_used_frame) {
+                    idle = entry;
+                }
+            } else if (!is_idle && entry->level_count - entry->dropped_levels > 1) {
+                if (!in_use || entry->last_used_frame < in_use->last_used_frame ||
+                    (entry->last_used_frame == in_use->last_used_frame && entry->bytes > in_use->bytes)) {
+                    in_use = entry;
+                }
+            }
+        }
+        if (idle) {
+            texture_budget_evict(budget, idle);
+        } else if (in_use && texture_budget_drop_level(budget, in_use)) {
+            budget->last_trim_frame = budget->frame;
+        } else {
+            // nothing left to trim, or the loader queue is full and the next fit tries again
+            break;
+        }
+    }
+}
+
+// Once the memory pressure is over, one texture in use at a time gets its dropped level back when it fits
+void texture_budget_restore(TextureBudget *budget) {
+    if (budget->frame - budget->last_trim_frame < TEXTURE_BUDGET_RESTORE_FRAMES) {
+        return;
+    }
+    size_t resident = texture_budget_resident(budget);
+    for (int i = 0; i < budget->count; ++i) {
+        BudgetTexture *entry = &budget->textures[i];
+        if (entry->dropped_levels == 0 || entry->evicted || entry->loading ||
+            budget->frame - entry->last_used_frame >= TEXTURE_BUDGET_IDLE_FRAMES) {
+            continue;
+        }
+        size_t restored = texture_budget_chain_bytes(entry, entry->dropped_levels - 1);
+        if (resident - entry->bytes + restored <= budget->budget) {
+            entry->dropped_levels--;
+            if (texture_budget_reload(budget, entry)) {
+                log_fmt("texture budget: loading the dropped level of %s again", entry->path);
+            } else {
+                entry->dropped_levels++;
+            }
+            return;
+        }
+    }
+}
+
+// After the draws of a frame
+void texture_budget_end_frame(TextureBudget *budget) {
+    texture_budget_fit(budget, budget->budget, TEXTURE_BUDGET_IDLE_FRAMES);
+    texture_budget_restore(budget);
+    budget->frame++;
+}
+
+// Memory pressure from the system, between frames. Keeps half the budget and only what the last frame drew.
+void texture_budget_trim(TextureBudget *budget) {
+    size_t before = texture_budget_resident(budget);
+    budget->last_trim_frame = budget->frame;
+    // the last frame is frame - 1
+    texture_budget_fit(budget, budget->budget / 2, 2);
+    log_fmt("texture budget: trimmed %d KB -> %d KB", (int) (before / 1024),
+            (int) (texture_budget_resident(budget) / 1024));
+}
+
+#endif //BLOCKS_GP_TEXTURE_BUDGET_H
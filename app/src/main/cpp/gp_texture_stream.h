@@ -0,0 +1,134 @@
+//
+// Progressive texture uploads. A loaded chain goes to GL from a small level first, so the model is drawn with a
+// blurry texture right away, then one level larger every step, within a per frame budget of uploaded bytes.
+//
+// ES 2 has no GL_TEXTURE_BASE_LEVEL, each step specifies the texture again with the next larger level as level 0
+// and every level below it. The texture name stays the same. Render thread only.
+//
+
+#ifndef BLOCKS_GP_TEXTURE_STREAM_H
+#define BLOCKS_GP_TEXTURE_STREAM_H
+
+#include <cstring>
+
+#include "gp_image.h"
+#include "gp_texture_budget.h"
+
+#define TEXTURE_STREAM_MAX 16
+// Largest side of the first level uploaded
+#define TEXTURE_STREAM_FIRST_SIZE 128
+
+typedef void (*TextureStreamRelease)(void *payload);
+
+typedef struct {
+    GLuint texture;
+    GLenum format;
+    GLenum type;
+    TextureSampler sampler;
+    // the full chain, owned by payload
+    int level_count;
+    const TextureLevel *levels;
+    // level 0 of the GL texture
+    int first_level;
+    TextureStreamRelease release;
+    void *payload;
+} TextureStream;
+
+typedef struct {
+    TextureBudget *budget;
+    int count;
+    TextureStream streams[TEXTURE_STREAM_MAX];
+} TextureStreams;
+
+void texture_streams_init(TextureStreams *streams, TextureBudget *budget) {
+    memset(streams, 0, sizeof(TextureStreams));
+    streams->budget = budget;
+}
+
+// Bytes specified by a step with first_level as level 0
+size_t texture_stream_step_bytes(const TextureStream *stream, int first_level) {
+    size_t bytes = 0;
+    for (int i = first_level; i < stream->level_count; ++i) {
+        bytes += stream->levels[i].size;
+    }
+    return bytes;
+}
+
+void texture_stream_upload(TextureStream *stream, int first_level) {
+    stream->first_level = first_level;
+    upload_texture_data(stream->texture, stream->format, stream->type, stream->levels + first_level,
+                        stream->level_count - first_level, stream->sampler);
+}
+
+// The levels the texture budget dropped are never uploaded
+int texture_stream_last_level(TextureStreams *streams, const TextureStream *stream) {
+    int dropped = texture_budget_dropped_levels(streams->budget, stream->texture);
+    return dropped < stream->level_count ? dropped : stream->level_count - 1;
+}
+
+void texture_stream_finish(TextureStreams *streams, TextureStream *stream) {
+    size_t level_bytes[IMAGE_MAX_LEVELS];
+    for (int i = 0; i < stream->level_count; ++i) {
+        level_bytes[i] = stream->levels[i].size;
+    }
+    texture_budget_uploaded(streams->budget, stream->texture, level_bytes, stream->level_count);
+    stream->release(stream->payload);
+}
+
+// Uploads the smallest levels now and queues the rest. levels stay valid until release(payload), which runs once
+// the last level is uploaded.
+void texture_stream_start(TextureStreams *streams, GLuint texture, GLenum format, GLenum type,
+                          const TextureLevel *levels, int level_count, TextureSampler sampler,
+                          TextureStreamRelease release, void *payload) {
+    TextureStream stream;
+    stream.texture = texture;
+    stream.format = format;
+    stream.type = type;
+    stream.sampler = sampler;
+    stream.level_count = level_count;
+    stream.levels = levels;
+    stream.release = release;
+    stream.payload = payload;
+
+    int last_level = texture_stream_last_level(streams, &stream);
+    int first_level = last_level;
+    while (first_level < level_count - 1 &&
+           (levels[first_level].width > TEXTURE_STREAM_FIRST_SIZE ||
+            levels[first_level].height > TEXTURE_STREAM_FIRST_SIZE)) {
+        first_level++;
+    }
+    if (first_level == last_level || streams->count == TEXTURE_STREAM_MAX) {
+        texture_stream_upload(&stream, last_level);
+        texture_stream_finish(streams, &stream);
+        return;
+    }
+    texture_stream_upload(&stream, first_level);
+    streams->streams[streams->count++] = stream;
+}
+
+// Once a frame. Uploads steps, oldest stream first, while they fit in budget_bytes. The first step of a frame
+// always runs, a step larger than the budget gets a frame of its own.
+void texture_streams_update(TextureStreams *streams, size_t budget_bytes) {
+    size_t spent = 0;
+    for (int i = 0; i < streams->count;) {
+        TextureStream *stream = &streams->streams[i];
+        int last_level = texture_stream_last_level(streams, stream);
+        while (stream->first_level > last_level) {
+            size_t step_bytes = texture_stream_step_bytes(stream, stream->first_level - 1);
+            if (spent > 0 && spent + step_bytes > budget_bytes) {
+                return;
+            }
+            texture_stream_upload(stream, stream->first_level - 1);
+            spent += step_bytes;
+        }
+        if (stream->first_level < last_level) {
+            // the budget dropped levels that are already up
+            texture_stream_upload(stream, last_level);
+        }
+        texture_stream_finish(streams, stream);
+        memmove(stream, stream + 1, sizeof(TextureStream) * (streams->count - i - 1));
+        streams->count--;
+    }
+}
+
+#endif //BLOCKS_GP_TEXTURE_STREAM_H
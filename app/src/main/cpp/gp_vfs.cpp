@@ -0,0 +1,162 @@
+//
+// Virtual file system over the asset pack, see gp_platform.h and gp_pack.h
+//
+
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <climits>
+
+#include "gp_platform.h"
+#include "gp_pack.h"
+
+static FileView pack_view;
+
+// FileView::handle of views that vfs_unmap_file releases itself
+static char pack_entry_handle;
+static char heap_handle;
+
+bool vfs_mount(const char *pack_name) {
+    vfs_unmount();
+
+    FileView view;
+    if (!platform_map_file(pack_name, &view)) {
+        log_fmt("vfs_mount: no %s, using loose files", pack_name);
+        return false;
+    }
+
+    // 64 bit sums, size_t wraps on the 32 bit ABIs
+    const auto *header = (const PackHeader *) view.data;
+    bool valid = view.size >= sizeof(PackHeader) && header->magic == PACK_MAGIC && header->version == PACK_VERSION &&
+                 header->table_size > header->entry_count && (header->table_size & (header->table_size - 1)) == 0 &&
+                 header->table_offset + (uint64_t) header->table_size * sizeof(PackEntry) <= view.size &&
+                 header->names_offset <= view.size;
+
+    const auto *entries = (const PackEntry *) ((const uint8_t *) view.data + header->table_offset);
+    uint32_t filled = 0;
+    for (uint32_t i = 0; valid && i < header->table_size; ++i) {
+        const PackEntry *entry = &entries[i];
+        filled += entry->name_length != 0;
+        // vfs_inflate allocates uncompressed_size + 1 and hands the sizes to stb as int
+        valid = entry->name_length == 0 ||
+                ((uint64_t) header->names_offset + entry->name_offset + entry->name_length <= view.size &&
+                 (uint64_t) entry->offset + entry->size <= view.size && entry->uncompressed_size < INT_MAX &&
+                 ((entry->flags & PACK_ENTRY_ZLIB) || entry->uncompressed_size == entry->size));
+    }
+    // table_size > entry_count then leaves the empty slot that ends every pack_find probe
+    valid = valid && filled == header->entry_count;
+    if (!valid) {
+        log_fmt("vfs_mount: %s is not a valid pack", pack_name);
+        platform_unmap_file(&view);
+        return false;
+    }
+
+    pack_view = view;
+    log_fmt("vfs_mount: %s %d entries %d bytes", pack_name, header->entry_count, (int) view.size);
+    return true;
+}
+
+void vfs_unmount() {
+    if (pack_view.data) {
+        platform_unmap_file(&pack_view);
+    }
+    memset(&pack_view, 0, sizeof(pack_view));
+}
+
+static const PackEntry *vfs_find(const char *file_name) {
+    return pack_view.data ? pack_find(pack_view.data, file_name) : nullptr;
+}
+
+// Inflates a compressed entry into a null terminated heap block
+static char *vfs_inflate(const PackEntry *entry) {
+    auto *data = (char *) malloc(entry->uncompressed_size + 1);
+    int inflated = stbi_zlib_decode_buffer(data, (int) entry->uncompressed_size,
+                                           (const char *) pack_view.data + entry->offset, (int) entry->size);
+    if (inflated != (int) entry->uncompressed_size) {
+        log_fmt("vfs: corrupted entry at %d", (int) entry->offset);
+        free(data);
+        return nullptr;
+    }
+    data[entry->uncompressed_size] = '\0';
+    return data;
+}
+
+char *vfs_read_entire_file(const char *file_name, char mode) {
+    const PackEntry *entry = vfs_find(file_name);
+    if (!entry) {
+        return platform_read_entire_file(file_name, mode);
+    }
+    if (entry->flags & PACK_ENTRY_ZLIB) {
+        return vfs_inflate(entry);
+    }
+    // callers own and free the result, so stored entries are copied too
+    auto *data = (char *) malloc(entry->size + 1);
+    memcpy(data, (const char *) pack_view.data + entry->offset, entry->size);
+    data[entry->size] = '\0';
+    return data;
+}
+
+bool vfs_map_file(const char *file_name, FileView *view) {
+    const PackEntry *entry = vfs_find(file_name);
+    if (!entry) {
+        return platform_map_file(file_name, view);
+    }
+    if (entry->flags & PACK_ENTRY_ZLIB) {
+        view->data = vfs_inflate(entry);
+        view->size = entry->uncompressed_size;
+        view->handle = &heap_handle;
+        return view->data != nullptr;
+    }
+    view->data = (const char *) pack_view.data + entry->offset;
+    view->size = entry->size;
+    view->handle = &pack_entry_handle;
+    return true;
+}
+
+void vfs_unmap_file(FileView *view) {
+    if (view->handle == &heap_handle) {
+        free((void *) view->data);
+    } else if (view->handle != &pack_entry_handle) {
+        platform_unmap_file(view);
+    }
+    view->data = nullptr;
+    view->size = 0;
+    view->handle = nullptr;
+}
+
+typedef struct {
+    FileView view;
+    size_t position;
+} MemoryReader;
+
+static int memory_reader_read(void *handle, char *buffer, int size) {
+    auto *reader = (MemoryReader *) handle;
+    size_t left = reader->view.size - reader->position;
+    size_t count = (size_t) size < left ? (size_t) size : left;
+    memcpy(buffer, (const char *) reader->view.data + reader->position, count);
+    reader->position += count;
+    return (int) count;
+}
+
+static void memory_reader_close(void *handle) {
+    auto *reader = (MemoryReader *) handle;
+    vfs_unmap_file(&reader->view);
+    free(reader);
+}
+
+// Compressed entries are inflated whole before the first block, pack_assets keeps the streamed formats stored
+bool vfs_open_file_reader(const char *file_name, FileReader *reader) {
+    if (!vfs_find(file_name)) {
+        return platform_open_file_reader(file_name, reader);
+    }
+    auto *memory = (MemoryReader *) malloc(sizeof(MemoryReader));
+    memory->position = 0;
+    if (!vfs_map_file(file_name, &memory->view)) {
+        free(memory);
+        return false;
+    }
+    reader->handle = memory;
+    reader->read = memory_reader_read;
+    reader->close = memory_reader_close;
+    return true;
+}
@@ -540,7 +540,10 @@ void Engine::TermDisplay() { gl_context_->Suspend(); }
 
 void Engine::TrimMemory() {
     android_log_str("Trimming memory");
-    gl_context_->Invalidate();
+    // the game gives back texture memory and keeps running, the context stays
+    if (initialized_resources_ && eglGetCurrentContext() != EGL_NO_CONTEXT) {
+        trim_memory_game();
+    }
 }
 
 /**
@@ -600,7 +603,7 @@ void Engine::HandleCmd(struct android_app *app, int32_t cmd) {
             eng->DrawFrame(eng, app->activity->assetManager);
             break;
         case APP_CMD_LOW_MEMORY:
-            // Free up GL resources
+            // Free up texture memory
             eng->TrimMemory();
             break;
     }
@@ -0,0 +1,145 @@
+//
+// Throughput of the pixel kernels in gp_pixels.h against their scalar twins, on an image or on random texels.
+// Every kernel must give the same bytes as its scalar twin, exits with 1 when one does not.
+//
+// usage: bench_pixels [image.png] [iterations]
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+#include "gp_platform.h"
+#include "gp_pixels.h"
+
+static int failures = 0;
+
+static double time_ms() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<double, std::milli>(now).count();
+}
+
+typedef void (*Kernel)(void *output, bool scalar);
+
+typedef struct {
+    const unsigned char *rgba;
+    const unsigned char *rgb;
+    int width;
+    int height;
+    // written by the kernels, one per variant
+    unsigned char *outputs[2];
+} Buffers;
+
+static Buffers buffers;
+
+static size_t texel_count() {
+    return (size_t) buffers.width * buffers.height;
+}
+
+static void flip_kernel(void *output, bool scalar) {
+    auto *pixels = (unsigned char *) output;
+    (scalar ? pixels_flip_rows_scalar : pixels_flip_rows)(pixels, buffers.width, buffers.height, 4);
+}
+
+static void expand_kernel(void *output, bool scalar) {
+    (scalar ? pixels_rgb_to_rgba_scalar : pixels_rgb_to_rgba)(buffers.rgb, (unsigned char *) output, texel_count());
+}
+
+static void premultiply_kernel(void *output, bool scalar) {
+    (scalar ? pixels_premultiply_alpha_scalar : pixels_premultiply_alpha)((unsigned char *) output, texel_count());
+}
+
+static void rgb565_kernel(void *output, bool scalar) {
+    (scalar ? pixels_pack_rgb565_scalar : pixels_pack_rgb565)(buffers.rgba, (uint16_t *) output, texel_count());
+}
+
+static void rgba4444_kernel(void *output, bool scalar) {
+    (scalar ? pixels_pack_rgba4444_scalar : pixels_pack_rgba4444)(buffers.rgba, (uint16_t *) output,
+                                                                  texel_count());
+}
+
+static void rgba5551_kernel(void *output, bool scalar) {
+    (scalar ? pixels_pack_rgba5551_scalar : pixels_pack_rgba5551)(buffers.rgba, (uint16_t *) output,
+                                                                  texel_count());
+}
+
+static void extract_kernel(void *output, bool scalar) {
+    (scalar ? pixels_extract_channel_scalar : pixels_extract_channel)(buffers.rgba, 4, 1, (unsigned char *) output,
+                                                                      texel_count());
+}
+
+// in_place kernels start from a copy of the RGBA texels every run, the copy is not timed
+static void bench(const char *name, Kernel kernel, bool in_place, size_t input_size, size_t output_size,
+                  int iterations) {
+    double ms[2] = {0, 0};
+    for (int variant = 0; variant < 2; ++variant) {
+        unsigned char *output = buffers.outputs[variant];
+        for (int i = 0; i < iterations; ++i) {
+            if (in_place) {
+                memcpy(output, buffers.rgba, output_size);
+            }
+            double start = time_ms();
+            kernel(output, variant == 0);
+            ms[variant] += time_ms() - start;
+        }
+    }
+    bool same = memcmp(buffers.outputs[0], buffers.outputs[1], output_size) == 0;
+    double megabytes = input_size / (1024.0 * 1024.0) * iterations;
+    printf("%-12s scalar %8.1f MB/s  %s %8.1f MB/s  x%.2f%s\n", name, megabytes / (ms[0] / 1000.0),
+           pixels_simd_name(), megabytes / (ms[1] / 1000.0), ms[0] / ms[1], same ? "" : "  MISMATCH");
+    if (!same) {
+        failures++;
+    }
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 2 ? atoi(argv[2]) : 10;
+    unsigned char *image = nullptr;
+    if (argc > 1) {
+        int channels;
+        image = stbi_load(argv[1], &buffers.width, &buffers.height, &channels, 4);
+        if (!image) {
+            printf("could not load %s\n", argv[1]);
+            return 1;
+        }
+    } else {
+        // odd sizes leave texels for the scalar tails
+        buffers.width = 2047;
+        buffers.height = 1023;
+        image = (unsigned char *) malloc(texel_count() * 4);
+        srand(1);
+        for (size_t i = 0; i < texel_count() * 4; ++i) {
+            image[i] = (unsigned char) (rand() & 0xFF);
+        }
+    }
+    buffers.rgba = image;
+    auto *rgb = (unsigned char *) malloc(texel_count() * 3);
+    for (size_t i = 0; i < texel_count(); ++i) {
+        memcpy(rgb + i * 3, image + i * 4, 3);
+    }
+    buffers.rgb = rgb;
+    buffers.outputs[0] = (unsigned char *) malloc(texel_count() * 4);
+    buffers.outputs[1] = (unsigned char *) malloc(texel_count() * 4);
+
+    printf("%d x %d, %d iterations\n", buffers.width, buffers.height, iterations);
+    size_t count = texel_count();
+    bench("flip", flip_kernel, true, count * 4, count * 4, iterations);
+    bench("rgb->rgba", expand_kernel, false, count * 3, count * 4, iterations);
+    bench("premultiply", premultiply_kernel, true, count * 4, count * 4, iterations);
+    bench("rgb565", rgb565_kernel, false, count * 4, count * 2, iterations);
+    bench("rgba4444", rgba4444_kernel, false, count * 4, count * 2, iterations);
+    bench("rgba5551", rgba5551_kernel, false, count * 4, count * 2, iterations);
+    bench("extract", extract_kernel, false, count * 4, count, iterations);
+
+    free(buffers.outputs[0]);
+    free(buffers.outputs[1]);
+    free(rgb);
+    if (argc > 1) {
+        stbi_image_free(image);
+    } else {
+        free(image);
+    }
+    printf(failures ? "%d kernels differ from the scalar code\n" : "all kernels match the scalar code\n", failures);
+    return failures ? 1 : 0;
+}
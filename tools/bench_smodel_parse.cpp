@@ -0,0 +1,134 @@
+//
+// Compares the text .smodel parser against the original strtok + strtof loop.
+//
+// usage: bench_smodel_parse duck.obj.smodel [iterations] [workers]
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+
+#include "gp_platform.h"
+#include "gp_model.h"
+#include "gp_jobs.h"
+
+// The parser as it was before gp_float_scan.h, minus the logging.
+static float *legacy_parse(char *file_data, int *out_count) {
+    char *token = strtok(file_data, " \n");
+    int stride = 8;
+    int size = 0;
+    float *data = nullptr;
+    int number_elements_read = 0;
+
+    do {
+        if (strcmp(token, "?") == 0) {
+            token = strtok(nullptr, " \n");
+            token = strtok(nullptr, " \n");
+            token = strtok(nullptr, " \n");
+            size = (int) strtol(token, nullptr, 10) * stride;
+            token = strtok(nullptr, " \n");
+            data = (float *) malloc(sizeof(float) * size);
+            continue;
+        }
+        if (strcmp(token, "%") == 0) {
+            token = strtok(nullptr, " \n");
+            continue;
+        }
+        if (strcmp(token, ">") == 0) {
+            for (int i = 0; i < 10; ++i) {
+                token = strtok(nullptr, " \n");
+            }
+            continue;
+        }
+        data[number_elements_read++] = strtof(token, nullptr);
+    } while ((token = strtok(nullptr, " \n")));
+
+    *out_count = number_elements_read;
+    return data;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s file.smodel [iterations] [workers]\n", argv[0]);
+        return 1;
+    }
+    int iterations = argc > 2 ? atoi(argv[2]) : 20;
+    // 0 starts one worker per core minus the calling thread
+    jobs_init(argc > 3 ? atoi(argv[3]) : 0);
+
+    char *text = read_entire_file(argv[1], 'r');
+    if (!text) {
+        return 1;
+    }
+    size_t length = strlen(text);
+    double megabytes = length / (1024.0 * 1024.0);
+    char *scratch = (char *) malloc(length + 1);
+
+    double legacy_time = 0;
+    float *legacy_data = nullptr;
+    int legacy_count = 0;
+    for (int i = 0; i < iterations; ++i) {
+        // strtok writes into the buffer, the copy is not timed
+        memcpy(scratch, text, length + 1);
+        free(legacy_data);
+        auto start = std::chrono::steady_clock::now();
+        legacy_data = legacy_parse(scratch, &legacy_count);
+        legacy_time += seconds_since(start);
+    }
+
+    double scan_time = 0;
+    SModelData model;
+    memset(&model, 0, sizeof(model));
+    for (int i = 0; i < iterations; ++i) {
+        free_smodel(&model);
+        auto start = std::chrono::steady_clock::now();
+        model = parse_smodel_text(text, length);
+        scan_time += seconds_since(start);
+    }
+
+    double parallel_time = 0;
+    SModelData parallel_model;
+    memset(&parallel_model, 0, sizeof(parallel_model));
+    for (int i = 0; i < iterations; ++i) {
+        free_smodel(&parallel_model);
+        auto start = std::chrono::steady_clock::now();
+        parallel_model = parse_smodel_text_parallel(text, length);
+        parallel_time += seconds_since(start);
+    }
+    bool parallel_identical = parallel_model.size == model.size &&
+                              memcmp(parallel_model.data, model.data, sizeof(float) * model.size) == 0;
+
+    int mismatches = 0;
+    float max_difference = 0;
+    for (int i = 0; i < model.size && i < legacy_count; ++i) {
+        if (model.data[i] != legacy_data[i]) {
+            mismatches++;
+            max_difference = fmaxf(max_difference, fabsf(model.data[i] - legacy_data[i]));
+        }
+    }
+
+    printf("\n%s: %.2f MB, %d floats, %d iterations\n", argv[1], megabytes, model.size, iterations);
+    printf("strtok + strtof: %8.2f ms %8.2f MB/s\n", 1000.0 * legacy_time / iterations,
+           megabytes * iterations / legacy_time);
+    printf("gp_float_scan:   %8.2f ms %8.2f MB/s\n", 1000.0 * scan_time / iterations,
+           megabytes * iterations / scan_time);
+    printf("parallel (%d threads): %8.2f ms %8.2f MB/s, bit identical to serial: %s\n",
+           jobs_worker_count() + 1, 1000.0 * parallel_time / iterations,
+           megabytes * iterations / parallel_time, parallel_identical ? "yes" : "NO");
+    printf("count legacy: %d scan: %d, values different from strtof: %d (max difference %g)\n",
+           legacy_count, model.size, mismatches, max_difference);
+
+    free(legacy_data);
+    free_smodel(&model);
+    free_smodel(&parallel_model);
+    jobs_shutdown();
+    free(scratch);
+    free(text);
+    return 0;
+}
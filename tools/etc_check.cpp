@@ -0,0 +1,143 @@
+//
+// Self check of the ETC1 encoder and decoder in gp_etc.h. Decodes hand built blocks against the layout of the
+// OES_compressed_ETC1_RGB8_texture specification, round trips solid colours, and reports PSNR and encode
+// time for the given images. Exits with 1 when any check fails.
+//
+// usage: etc_check [image.png...]
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+
+#include "gp_platform.h"
+#include "gp_jobs.h"
+#include "gp_etc.h"
+
+// Below this the encoder is broken rather than lossy, ETC1 usually lands between 32 and 40 dB on photos
+#define MIN_IMAGE_PSNR 28.0
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static double time_ms() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<double, std::milli>(now).count();
+}
+
+static bool texel_is(const unsigned char *texels, int x, int y, int r, int g, int b) {
+    const unsigned char *texel = texels + (y * 4 + x) * 3;
+    return texel[0] == r && texel[1] == g && texel[2] == b;
+}
+
+static void check_known_blocks() {
+    unsigned char texels[16 * 3];
+
+    // individual mode, left half red 15 -> 255, right half 0, table 0, every index 0 (+2)
+    {
+        unsigned char block[8] = {0xF0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+        etc1_decode_block(block, texels);
+        check(texel_is(texels, 0, 0, 255, 2, 2) && texel_is(texels, 1, 3, 255, 2, 2), "individual left half");
+        check(texel_is(texels, 2, 0, 2, 2, 2) && texel_is(texels, 3, 3, 2, 2, 2), "individual right half");
+    }
+    // same with the index of texel (1, 0) set to 2 (-2) through its most significant bit, bit 16 + 1 * 4 + 0
+    {
+        unsigned char block[8] = {0xF0, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00};
+        etc1_decode_block(block, texels);
+        check(texel_is(texels, 1, 0, 253, 0, 0), "texel index bits are column major");
+        check(texel_is(texels, 0, 1, 255, 2, 2), "other texels keep index 0");
+    }
+    // differential and flipped, green 16 -> 132 on top, delta -1 -> 15 -> 123 at the bottom, table 7 (+47)
+    {
+        uint32_t high = 16u << 19 | 7u << 16 | 7u << 5 | 7u << 2 | 1u << 1 | 1u;
+        unsigned char block[8] = {(unsigned char) (high >> 24), (unsigned char) (high >> 16),
+                                  (unsigned char) (high >> 8), (unsigned char) high, 0, 0, 0, 0};
+        etc1_decode_block(block, texels);
+        check(texel_is(texels, 3, 1, 47, 179, 47), "differential top half");
+        check(texel_is(texels, 0, 2, 47, 170, 47), "differential bottom half");
+    }
+}
+
+static void check_solid_colours() {
+    unsigned char texels[16 * 3];
+    unsigned char decoded[16 * 3];
+    unsigned char block[ETC1_BLOCK_SIZE];
+    int worst = 0;
+    for (int r = 0; r < 256; r += 15) {
+        for (int g = 0; g < 256; g += 17) {
+            for (int b = 0; b < 256; b += 51) {
+                for (int i = 0; i < 16; ++i) {
+                    texels[i * 3] = (unsigned char) r;
+                    texels[i * 3 + 1] = (unsigned char) g;
+                    texels[i * 3 + 2] = (unsigned char) b;
+                }
+                etc1_encode_block(texels, block);
+                etc1_decode_block(block, decoded);
+                for (int i = 0; i < 16 * 3; ++i) {
+                    int error = abs(decoded[i] - texels[i]);
+                    worst = error > worst ? error : worst;
+                }
+            }
+        }
+    }
+    printf("solid colours: worst channel error %d\n", worst);
+    check(worst <= 8, "solid colours within 8 levels");
+}
+
+static void check_image(const char *file_name) {
+    int width;
+    int height;
+    int channels;
+    unsigned char *pixels = stbi_load(file_name, &width, &height, &channels, 0);
+    if (!pixels || channels < 3) {
+        printf("%s: not an RGB(A) image\n", file_name);
+        failures++;
+        stbi_image_free(pixels);
+        return;
+    }
+
+    auto *compressed = (unsigned char *) malloc(etc1_image_size(width, height));
+    double start = time_ms();
+    etc1_encode_image(pixels, width, height, channels, compressed);
+    double encode_ms = time_ms() - start;
+
+    auto *decoded = (unsigned char *) malloc((size_t) width * height * 3);
+    etc1_decode_image(compressed, width, height, 3, decoded);
+    double squared_error = 0;
+    for (size_t i = 0; i < (size_t) width * height; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            double d = decoded[i * 3 + c] - pixels[i * channels + c];
+            squared_error += d * d;
+        }
+    }
+    double mse = squared_error / ((double) width * height * 3);
+    double psnr = mse > 0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+    printf("%s: %dx%d, %zu -> %zu bytes, %.2f dB, encoded in %.1f ms on %d threads\n", file_name, width, height,
+           (size_t) width * height * channels, etc1_image_size(width, height), psnr, encode_ms,
+           jobs_worker_count() + 1);
+    check(psnr >= MIN_IMAGE_PSNR, file_name);
+
+    free(decoded);
+    free(compressed);
+    stbi_image_free(pixels);
+}
+
+int main(int argc, char **argv) {
+    jobs_init(0);
+    check_known_blocks();
+    check_solid_colours();
+    for (int i = 1; i < argc; ++i) {
+        check_image(argv[i]);
+    }
+    jobs_shutdown();
+    printf(failures ? "%d checks failed\n" : "all checks passed\n", failures);
+    return failures ? 1 : 0;
+}
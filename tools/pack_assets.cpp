@@ -0,0 +1,161 @@
+//
+// Builds the asset pack described in gp_pack.h from loose files. Entries are named after the file name
+// without its directories, the way the game asks for them.
+//
+// usage: pack_assets [-z] output.pak file...
+//
+// -z stores zlib compressed entries when that saves at least PACK_MIN_SAVING, except for the formats that are
+// used in place from the mapping (.smodelb, .ktx) or streamed (.smodel), see keep_stored. Needs -lz.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "gp_platform.h"
+#include "gp_pack.h"
+#include "gp_ktx.h"
+
+#define PACK_MIN_SAVING 0.1
+
+typedef struct {
+    const char *name;
+    std::vector<uint8_t> data;
+    uint32_t uncompressed_size;
+    uint32_t flags;
+} PackInput;
+
+static bool ends_with(const char *text, const char *suffix) {
+    size_t text_length = strlen(text);
+    size_t suffix_length = strlen(suffix);
+    return text_length >= suffix_length && strcmp(text + text_length - suffix_length, suffix) == 0;
+}
+
+// The game reads a compressed entry by inflating all of it to the heap, these would lose the mapping or the
+// small streaming block they are read through
+static bool keep_stored(const char *name) {
+    return ends_with(name, ".smodel") || ends_with(name, ".smodelb") || ends_with(name, KTX_EXTENSION);
+}
+
+static bool read_file(const char *path, std::vector<uint8_t> *data) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    data->resize((size_t) ftell(file));
+    fseek(file, 0, SEEK_SET);
+    size_t read = fread(data->data(), 1, data->size(), file);
+    fclose(file);
+    return read == data->size();
+}
+
+static size_t align(size_t offset) {
+    return (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+}
+
+int main(int argc, char **argv) {
+    int first_input = 2;
+    bool compress_entries = argc > 1 && strcmp(argv[1], "-z") == 0;
+    if (compress_entries) first_input++;
+    if (argc <= first_input) {
+        printf("usage: %s [-z] output.pak file...\n", argv[0]);
+        return 1;
+    }
+    const char *output_name = argv[first_input - 1];
+
+    std::vector<PackInput> inputs;
+    for (int i = first_input; i < argc; ++i) {
+        PackInput input;
+        const char *slash = strrchr(argv[i], '/');
+        input.name = slash ? slash + 1 : argv[i];
+        if (!read_file(argv[i], &input.data)) {
+            log_fmt("could not read %s", argv[i]);
+            return 1;
+        }
+        input.uncompressed_size = (uint32_t) input.data.size();
+        input.flags = 0;
+
+        if (compress_entries && !keep_stored(input.name)) {
+            uLongf compressed_size = compressBound(input.data.size());
+            std::vector<uint8_t> compressed(compressed_size);
+            if (compress2(compressed.data(), &compressed_size, input.data.data(), input.data.size(), 9) == Z_OK &&
+                compressed_size < input.data.size() * (1.0 - PACK_MIN_SAVING)) {
+                compressed.resize(compressed_size);
+                input.data.swap(compressed);
+                input.flags |= PACK_ENTRY_ZLIB;
+            }
+        }
+        log_fmt("%s: %d -> %d bytes%s", input.name, (int) input.uncompressed_size, (int) input.data.size(),
+                input.flags & PACK_ENTRY_ZLIB ? " zlib" : "");
+        inputs.push_back(input);
+    }
+
+    PackHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = PACK_MAGIC;
+    header.version = PACK_VERSION;
+    header.entry_count = (uint32_t) inputs.size();
+    header.table_size = 1;
+    while (header.table_size < header.entry_count * 2) header.table_size <<= 1;
+    header.table_offset = sizeof(PackHeader);
+    header.names_offset = header.table_offset + header.table_size * sizeof(PackEntry);
+
+    std::vector<PackEntry> table(header.table_size);
+    memset(table.data(), 0, table.size() * sizeof(PackEntry));
+    std::string names;
+    std::vector<uint32_t> slots;
+
+    for (const PackInput &input : inputs) {
+        size_t length = strlen(input.name);
+        uint32_t hash = pack_hash_name(input.name, length);
+        uint32_t slot = hash & (header.table_size - 1);
+        while (table[slot].name_length != 0) {
+            if (table[slot].name_hash == hash && table[slot].name_length == length &&
+                names.compare(table[slot].name_offset, length, input.name) == 0) {
+                log_fmt("duplicate entry %s", input.name);
+                return 1;
+            }
+            slot = (slot + 1) & (header.table_size - 1);
+        }
+        table[slot].name_hash = hash;
+        table[slot].name_offset = (uint32_t) names.size();
+        table[slot].name_length = (uint32_t) length;
+        table[slot].flags = input.flags;
+        table[slot].size = (uint32_t) input.data.size();
+        table[slot].uncompressed_size = input.uncompressed_size;
+        names.append(input.name, length);
+        slots.push_back(slot);
+    }
+
+    size_t offset = align(header.names_offset + names.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        table[slots[i]].offset = (uint32_t) offset;
+        offset = align(offset + inputs[i].data.size());
+    }
+
+    FILE *file = fopen(output_name, "wb");
+    if (!file) {
+        log_fmt("could not open %s", output_name);
+        return 1;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(table.data(), sizeof(PackEntry), table.size(), file);
+    fwrite(names.data(), 1, names.size(), file);
+    size_t written = header.names_offset + names.size();
+    const char padding[PACK_ALIGNMENT] = {0};
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        fwrite(padding, 1, table[slots[i]].offset - written, file);
+        fwrite(inputs[i].data.data(), 1, inputs[i].data.size(), file);
+        written = table[slots[i]].offset + inputs[i].data.size();
+    }
+    bool failed = ferror(file) != 0;
+    fclose(file);
+
+    log_fmt("%s: %d entries %d bytes", output_name, (int) inputs.size(), (int) written);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,67 @@
+//
+// Converts text .smodel files into the binary .smodelb container described in gp_model.h
+// The models are welded, optimized for the vertex cache, simplified into detail levels and quantized so none
+// of that runs on device.
+//
+// usage: smodel_convert input.smodel [output.smodelb]
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "gp_platform.h"
+#include "gp_model.h"
+#include "gp_mesh.h"
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s input.smodel [output.smodelb]\n", argv[0]);
+        return 1;
+    }
+
+    const char *input_name = argv[1];
+    char output_name[1024];
+    if (argc > 2) {
+        snprintf(output_name, sizeof(output_name), "%s", argv[2]);
+    } else {
+        snprintf(output_name, sizeof(output_name), "%s%s", input_name, SMODEL_BINARY_EXTENSION);
+    }
+
+    char *text = read_entire_file(input_name, 'r');
+    if (!text) {
+        return 1;
+    }
+
+    // the parser takes ownership of the text
+    SModelData model = parse_smodel_file_as_single_model(text);
+
+    // 32 bit indices are not available everywhere, those models stay unindexed
+    if (mesh_weld(&model, false, nullptr)) {
+        MeshCacheStats before = mesh_cache_stats(&model, MESH_VERTEX_CACHE_SIZE);
+        mesh_optimize(&model);
+        MeshCacheStats after = mesh_cache_stats(&model, MESH_VERTEX_CACHE_SIZE);
+        log_fmt("ACMR %.3f -> %.3f ATVR %.3f -> %.3f", before.acmr, after.acmr, before.atvr, after.atvr);
+
+        mesh_build_lods(&model, SMODEL_MAX_LODS);
+        MeshLodStats lod_stats = mesh_lod_stats(&model);
+        for (int lod = 0; lod < lod_stats.lod_count; ++lod) {
+            log_fmt("lod %d: %d triangles error %f", lod, lod_stats.triangle_count[lod], lod_stats.error[lod]);
+        }
+    }
+
+    MeshQuantizeStats quantize_stats;
+    mesh_quantize(&model, &quantize_stats);
+    log_fmt("vertex memory %d -> %d bytes, max position error %f", quantize_stats.vertex_bytes_before,
+            quantize_stats.vertex_bytes_after, quantize_stats.max_position_error);
+
+    if (!write_smodel_binary(&model, output_name)) {
+        return 1;
+    }
+
+    log_fmt("%s -> %s: %d vertices, %d indices, %d submodels", input_name, output_name,
+            model.vertex_number, model.index_count, model.submodel_count);
+
+    free_smodel(&model);
+    return 0;
+}
@@ -0,0 +1,119 @@
+//
+// Converts images into the KTX containers described in gp_ktx.h, with the full mip chain baked in so the game
+// neither decodes nor filters anything for them.
+//
+// usage: texture_convert [-flip] [-srgb] [-etc1] input.png [output.ktx]
+//
+//   -flip  flips the rows like LOAD_TEXTURE_FLIP, the textures of the game are all flipped
+//   -srgb  colour image, the mip levels are averaged in linear space
+//   -etc1  ETC1 levels (alpha is dropped) instead of RGBA8
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "gp_platform.h"
+#include "gp_jobs.h"
+#include "gp_image.h"
+#include "gp_etc.h"
+#include "gp_ktx.h"
+
+int main(int argc, char **argv) {
+    bool flip = false;
+    bool srgb = false;
+    bool etc1 = false;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+        if (strcmp(argv[arg], "-flip") == 0) {
+            flip = true;
+        } else if (strcmp(argv[arg], "-srgb") == 0) {
+            srgb = true;
+        } else if (strcmp(argv[arg], "-etc1") == 0) {
+            etc1 = true;
+        } else {
+            printf("unknown option %s\n", argv[arg]);
+            return 1;
+        }
+    }
+    if (arg >= argc) {
+        printf("usage: %s [-flip] [-srgb] [-etc1] input.png [output.ktx]\n", argv[0]);
+        return 1;
+    }
+
+    const char *input_name = argv[arg];
+    char output_name[1024];
+    if (arg + 1 < argc) {
+        snprintf(output_name, sizeof(output_name), "%s", argv[arg + 1]);
+    } else {
+        // duck.png -> duck.ktx, the name the game looks for next to the image
+        const char *extension = strrchr(input_name, '.');
+        int stem_length = extension ? (int) (extension - input_name) : (int) strlen(input_name);
+        snprintf(output_name, sizeof(output_name), "%.*s%s", stem_length, input_name, KTX_EXTENSION);
+    }
+
+    // always 4 channels, RGBA8 rows are 4 byte aligned as KTX wants them
+    int width;
+    int height;
+    int channels;
+    stbi_set_flip_vertically_on_load(flip);
+    unsigned char *pixels = stbi_load(input_name, &width, &height, &channels, 4);
+    if (!pixels) {
+        printf("could not load %s\n", input_name);
+        return 1;
+    }
+
+    ImageMips mips;
+    image_build_mips(pixels, width, height, 4, srgb, &mips);
+
+    TextureLevel levels[IMAGE_MAX_LEVELS];
+    unsigned char *compressed = nullptr;
+    if (etc1) {
+        jobs_init(0);
+        size_t total_size = 0;
+        for (int i = 0; i < mips.level_count; ++i) {
+            total_size += etc1_image_size(mips.levels[i].width, mips.levels[i].height);
+        }
+        compressed = (unsigned char *) malloc(total_size);
+        size_t offset = 0;
+        for (int i = 0; i < mips.level_count; ++i) {
+            const ImageLevel *source = &mips.levels[i];
+            levels[i].width = source->width;
+            levels[i].height = source->height;
+            levels[i].data = compressed + offset;
+            levels[i].size = etc1_image_size(source->width, source->height);
+            etc1_encode_image(source->pixels, source->width, source->height, 4, compressed + offset);
+            offset += levels[i].size;
+        }
+        jobs_shutdown();
+    } else {
+        for (int i = 0; i < mips.level_count; ++i) {
+            const ImageLevel *source = &mips.levels[i];
+            levels[i].width = source->width;
+            levels[i].height = source->height;
+            levels[i].data = source->pixels;
+            levels[i].size = (size_t) source->width * source->height * 4;
+        }
+    }
+
+    const char *orientation = flip ? KTX_ORIENTATION_FLIPPED : KTX_ORIENTATION_AS_IS;
+    bool written;
+    if (etc1) {
+        written = write_ktx(output_name, 0, 0, ETC1_RGB8_FORMAT, KTX_GL_RGB, levels, mips.level_count, orientation);
+    } else {
+        written = write_ktx(output_name, KTX_GL_UNSIGNED_BYTE, KTX_GL_RGBA, KTX_GL_RGBA8, KTX_GL_RGBA, levels,
+                            mips.level_count, orientation);
+    }
+
+    size_t total_size = 0;
+    for (int i = 0; i < mips.level_count; ++i) {
+        total_size += levels[i].size;
+    }
+    printf("%s -> %s: %dx%d, %d levels, %s, %zu bytes\n", input_name, output_name, width, height, mips.level_count,
+           etc1 ? "ETC1" : "RGBA8", total_size);
+
+    free(compressed);
+    image_free_mips(&mips);
+    stbi_image_free(pixels);
+    return written ? 0 : 1;
+}